@@ -0,0 +1,206 @@
+// benchmarks `engine::flatHashMap` against `std::unordered_map` on the ecs' key distributions. prints one CSV row per
+// measurement to stdout: container,keys,benchmark,entries,seconds,nsPerOperation
+// usage: flatHashMapBenchmarks [--sizes 8,64,...] [--repeats n]
+// every benchmark keeps the fastest of its repeats
+#include "ecs/ecs.hpp"
+#include "engine/flatHashMap.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+// lookups per measurement, so small maps are measured over enough operations
+constexpr size_t lookupsCount = 1'000'000;
+
+// keeps the measured loops from being optimized away
+volatile size_t s_sink = 0;
+
+struct benchmarkOptions
+{
+    std::vector<size_t> sizes{8, 64, 512, 4096, 65536};
+    size_t repeats = 3;
+};
+
+template <typename Func>
+double measure(Func &&func)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// like `getTypeHash_`, the hashes of distinct type names
+std::vector<size_t> componentKeys(const size_t count)
+{
+    std::vector<size_t> result;
+    for (size_t i = 0; i < count; i++)
+    {
+        const std::string name = "size_t getTypeHash_() [with T = game::component" + std::to_string(i) + "]";
+        result.push_back(fnv1a_64_(name.data(), name.size()));
+    }
+    return result;
+}
+
+// like the archetypes' hashes, the combined hashes of distinct sorted sets of 2-8 of 64 components
+std::vector<size_t> archetypeKeys(const size_t count)
+{
+    const std::vector<size_t> components = componentKeys(64);
+    std::mt19937_64 random(42);
+    std::vector<size_t> result;
+    std::unordered_set<size_t> seen;
+    while (result.size() < count)
+    {
+        std::vector<size_t> hashes = components;
+        std::shuffle(hashes.begin(), hashes.end(), random);
+        hashes.resize(2 + random() % 7);
+        std::sort(hashes.begin(), hashes.end(), std::greater<size_t>());
+        const size_t hash = ecs::getHash_(hashes);
+        if (seen.insert(hash).second)
+            result.push_back(hash);
+    }
+    return result;
+}
+
+// keys that aren't in the map, from the same distribution
+std::vector<size_t> missingKeys(const std::vector<size_t> &keys)
+{
+    std::vector<size_t> result;
+    for (const size_t key : keys)
+        result.push_back(key * 0x100000001b3ULL ^ 0xcbf29ce484222325ULL);
+    return result;
+}
+
+// lookupsCount keys in a fixed random order
+std::vector<size_t> lookupOrder(const std::vector<size_t> &keys)
+{
+    std::mt19937_64 random(7);
+    std::vector<size_t> result(lookupsCount);
+    for (size_t &key : result)
+        key = keys[random() % keys.size()];
+    return result;
+}
+
+void print(const std::string_view container, const std::string_view keys, const std::string_view benchmark, const size_t entriesCount, const double seconds, const size_t operationsCount)
+{
+    std::printf("%.*s,%.*s,%.*s,%zu,%.9f,%.3f\n", static_cast<int>(container.size()), container.data(), static_cast<int>(keys.size()), keys.data(), static_cast<int>(benchmark.size()), benchmark.data(), entriesCount, seconds, seconds * 1e9 / operationsCount);
+}
+
+// the value is the size of an archetype's component to column entry
+template <typename Map>
+void benchmarkMap(const std::string_view container, const std::string_view keysName, const std::vector<size_t> &keys, const size_t repeats)
+{
+    const std::vector<size_t> hits = lookupOrder(keys);
+    const std::vector<size_t> misses = lookupOrder(missingKeys(keys));
+    // inserts are repeated over fresh maps so small ones take long enough to measure
+    const size_t insertRounds = std::max<size_t>(1, lookupsCount / keys.size());
+
+    double insert = 1e30, findHit = 1e30, findMiss = 1e30, iterate = 1e30;
+    for (size_t r = 0; r < repeats; r++)
+    {
+        insert = std::min(insert, measure([&] {
+                              for (size_t round = 0; round < insertRounds; round++)
+                              {
+                                  Map map;
+                                  for (size_t i = 0; i < keys.size(); i++)
+                                      map.insert({keys[i], i});
+                                  s_sink = s_sink + map.size();
+                              }
+                          }));
+
+        Map map;
+        for (size_t i = 0; i < keys.size(); i++)
+            map.insert({keys[i], i});
+        findHit = std::min(findHit, measure([&] {
+                               size_t sum = 0;
+                               for (const size_t key : hits)
+                                   sum += map.find(key)->second;
+                               s_sink = sum;
+                           }));
+        findMiss = std::min(findMiss, measure([&] {
+                                size_t found = 0;
+                                for (const size_t key : misses)
+                                    found += map.find(key) != map.end();
+                                s_sink = found;
+                            }));
+        iterate = std::min(iterate, measure([&] {
+                               size_t sum = 0;
+                               for (size_t round = 0; round < insertRounds; round++)
+                                   for (const auto &[key, value] : map)
+                                       sum += value;
+                               s_sink = sum;
+                           }));
+    }
+    print(container, keysName, "insert", keys.size(), insert, insertRounds * keys.size());
+    print(container, keysName, "findHit", keys.size(), findHit, lookupsCount);
+    print(container, keysName, "findMiss", keys.size(), findMiss, lookupsCount);
+    print(container, keysName, "iterate", keys.size(), iterate, insertRounds * keys.size());
+    std::fflush(stdout);
+}
+
+void benchmarkKeys(const std::string_view keysName, const std::vector<size_t> &keys, const size_t repeats)
+{
+    benchmarkMap<engine::flatHashMap<size_t, size_t>>("flatHashMap", keysName, keys, repeats);
+    benchmarkMap<std::unordered_map<size_t, size_t>>("unordered_map", keysName, keys, repeats);
+}
+
+// comma separated sizes
+std::vector<size_t> parseSizes(const char *text)
+{
+    std::vector<size_t> result;
+    for (char *end; *text; text = *end ? end + 1 : end)
+    {
+        result.push_back(std::strtoull(text, &end, 10));
+        if (end == text || result.back() == 0)
+        {
+            std::fprintf(stderr, "invalid sizes: %s\n", text);
+            std::exit(1);
+        }
+    }
+    return result;
+}
+
+benchmarkOptions parseOptions(const int argc, char **argv)
+{
+    benchmarkOptions result;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "missing value of %s\n", argv[i]);
+            std::exit(1);
+        }
+        const char *value = argv[++i];
+        if (arg == "--sizes")
+            result.sizes = parseSizes(value);
+        else if (arg == "--repeats")
+            result.repeats = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            std::exit(1);
+        }
+    }
+    return result;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const benchmarkOptions options = parseOptions(argc, argv);
+    std::printf("container,keys,benchmark,entries,seconds,nsPerOperation\n");
+    for (const size_t count : options.sizes)
+    {
+        benchmarkKeys("components", componentKeys(count), options.repeats);
+        benchmarkKeys("archetypes", archetypeKeys(count), options.repeats);
+    }
+    std::fprintf(stderr, "checksum %zu\n", static_cast<size_t>(s_sink));
+}
@@ -0,0 +1,397 @@
+// benchmarks the archetype `ecs::World` against the `engine::entity` object model. prints one CSV row per
+// measurement to stdout: model,benchmark,entities,seconds,nsPerEntity
+// usage: ecsBenchmarks [--sizes 10000,100000,...] [--models ecs,entity] [--repeats n]
+// every benchmark keeps the fastest of its repeats
+#include "ecs/ecs.hpp"
+#include "engine/app.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    float x, y, z;
+};
+
+struct Velocity
+{
+    float x, y, z;
+};
+
+struct Acceleration
+{
+    float x, y, z;
+};
+
+struct Health
+{
+    float value;
+};
+
+// added and removed by the add/remove component benchmarks
+struct Marker
+{
+    int value;
+};
+
+// whether `position::update_` integrates, only during the parallel iteration of the object model
+bool s_moving = false;
+
+struct velocity : engine::component
+{
+    float x = 1, y = 1, z = 1;
+};
+
+struct acceleration : engine::component
+{
+    float x = 1, y = 1, z = 1;
+};
+
+struct health : engine::component
+{
+    float value = 100;
+};
+
+struct marker : engine::component
+{
+    int value = 0;
+};
+
+struct position : engine::component
+{
+    float x = 0, y = 0, z = 0;
+
+  private:
+    void update_() override
+    {
+        if (!s_moving)
+            return;
+        const auto v = getEntity()->getComponent<velocity>();
+        x += v->x;
+        y += v->y;
+        z += v->z;
+    }
+};
+
+// keeps the measured loops from being optimized away
+volatile double s_sink = 0;
+
+struct benchmarkOptions
+{
+    std::vector<size_t> sizes{10'000, 100'000, 1'000'000, 10'000'000};
+    bool ecs = true;
+    bool entity = true;
+    size_t repeats = 1;
+};
+
+// fastest seconds of every benchmark of one model at one size, in the order they first ran
+struct benchmarkResults
+{
+    std::vector<std::pair<std::string_view, double>> seconds;
+
+    void add(const std::string_view benchmark, const double value)
+    {
+        for (auto &[name, best] : seconds)
+            if (name == benchmark)
+            {
+                best = std::min(best, value);
+                return;
+            }
+        seconds.push_back({benchmark, value});
+    }
+
+    void print(const std::string_view model, const size_t entitiesCount) const
+    {
+        for (const auto &[name, value] : seconds)
+            std::printf("%.*s,%.*s,%zu,%.9f,%.3f\n", static_cast<int>(model.size()), model.data(), static_cast<int>(name.size()), name.data(), entitiesCount, value, value * 1e9 / entitiesCount);
+        std::fflush(stdout);
+    }
+};
+
+template <typename Func>
+double measure(Func &&func)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    func();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// indices [0, count) in a fixed random order
+std::vector<size_t> shuffledIndices(const size_t count)
+{
+    std::vector<size_t> result(count);
+    std::iota(result.begin(), result.end(), 0);
+    std::shuffle(result.begin(), result.end(), std::mt19937_64(42));
+    return result;
+}
+
+void benchmarkEcs(const size_t count, benchmarkResults &results)
+{
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    entities.reserve(count);
+    results.add("spawn", measure([&] {
+                    for (size_t i = 0; i < count; i++)
+                        entities.push_back(world.addEntity(Position{0, 0, 0}, Velocity{1, 1, 1}, Acceleration{1, 1, 1}, Health{100}));
+                }));
+
+    results.add("iterate1", measure([&] {
+                    double sum = 0;
+                    world.execute([&](const Position &p) { sum += p.x; });
+                    s_sink = sum;
+                }));
+    results.add("iterate2", measure([&] {
+                    world.execute([](Position &p, const Velocity &v) {
+                        p.x += v.x;
+                        p.y += v.y;
+                        p.z += v.z;
+                    });
+                }));
+    results.add("iterate3", measure([&] {
+                    world.execute([](Position &p, Velocity &v, const Acceleration &a) {
+                        v.x += a.x;
+                        p.x += v.x;
+                        p.y += v.y;
+                        p.z += v.z;
+                    });
+                }));
+    results.add("iterate4", measure([&] {
+                    world.execute([](Position &p, Velocity &v, const Acceleration &a, const Health &h) {
+                        if (h.value <= 0)
+                            return;
+                        v.x += a.x;
+                        p.x += v.x;
+                        p.y += v.y;
+                        p.z += v.z;
+                    });
+                }));
+    results.add("iterateParallel", measure([&] {
+                    world.executeParallel([](Position &p, const Velocity &v) {
+                        p.x += v.x;
+                        p.y += v.y;
+                        p.z += v.z;
+                    });
+                }));
+
+    const std::vector<size_t> order = shuffledIndices(count);
+    results.add("randomGetComponent", measure([&] {
+                    double sum = 0;
+                    for (const size_t i : order)
+                        sum += world.getComponent<Position>(entities[i]).x;
+                    s_sink = sum;
+                }));
+
+    results.add("addComponent", measure([&] {
+                    for (const ecs::Entity entity : entities)
+                        world.addComponents(entity, Marker{1});
+                    world.flush();
+                }));
+    results.add("removeComponent", measure([&] {
+                    for (const ecs::Entity entity : entities)
+                        world.removeComponents<Marker>(entity);
+                    world.flush();
+                }));
+
+    // every other entity in random order, so the survivors are scattered through every chunk
+    for (size_t i = 0; i < count / 2; i++)
+        world.removeEntity(entities[order[i]]);
+    results.add("flushFragmented", measure([&] { world.flush(); }));
+
+    results.add("despawn", measure([&] {
+                    for (size_t i = count / 2; i < count; i++)
+                        world.removeEntity(entities[order[i]]);
+                    world.flush();
+                }));
+
+    ecs::World batchWorld;
+    results.add("spawnBatch", measure([&] {
+                    batchWorld.addEntities<Position, Velocity, Acceleration, Health>(count, [](size_t, Position &p, Velocity &v, Acceleration &a, Health &h) {
+                        p = {0, 0, 0};
+                        v = {1, 1, 1};
+                        a = {1, 1, 1};
+                        h = {100};
+                    });
+                }));
+
+    ecs::World prefabWorld;
+    const ecs::Prefab prefab = prefabWorld.createPrefab(Position{0, 0, 0}, Velocity{1, 1, 1}, Acceleration{1, 1, 1}, Health{100});
+    results.add("spawnPrefab", measure([&] { prefabWorld.instantiate(prefab, count); }));
+}
+
+void benchmarkEntity(const size_t count, benchmarkResults &results)
+{
+    std::vector<engine::weakRef<engine::entity>> entities;
+    entities.reserve(count);
+    // structural changes of the object model are applied once per frame
+    results.add("spawn", measure([&] {
+                    for (size_t i = 0; i < count; i++)
+                    {
+                        auto entity = engine::entity::create("benchmark");
+                        entity->addComponent<position>();
+                        entity->addComponent<velocity>();
+                        entity->addComponent<acceleration>();
+                        entity->addComponent<health>();
+                        entities.push_back(entity);
+                    }
+                    engine::application::updateEntities();
+                }));
+
+    results.add("iterate1", measure([&] {
+                    double sum = 0;
+                    for (const auto &entity : entities)
+                        sum += entity->getComponent<position>()->x;
+                    s_sink = sum;
+                }));
+    results.add("iterate2", measure([&] {
+                    for (const auto &entity : entities)
+                    {
+                        auto p = entity->getComponent<position>();
+                        const auto v = entity->getComponent<velocity>();
+                        p->x += v->x;
+                        p->y += v->y;
+                        p->z += v->z;
+                    }
+                }));
+    results.add("iterate3", measure([&] {
+                    for (const auto &entity : entities)
+                    {
+                        auto p = entity->getComponent<position>();
+                        auto v = entity->getComponent<velocity>();
+                        const auto a = entity->getComponent<acceleration>();
+                        v->x += a->x;
+                        p->x += v->x;
+                        p->y += v->y;
+                        p->z += v->z;
+                    }
+                }));
+    results.add("iterate4", measure([&] {
+                    for (const auto &entity : entities)
+                    {
+                        auto p = entity->getComponent<position>();
+                        auto v = entity->getComponent<velocity>();
+                        const auto a = entity->getComponent<acceleration>();
+                        if (entity->getComponent<health>()->value <= 0)
+                            continue;
+                        v->x += a->x;
+                        p->x += v->x;
+                        p->y += v->y;
+                        p->z += v->z;
+                    }
+                }));
+    results.add("iterateParallel", measure([&] {
+                    s_moving = true;
+                    engine::application::updateEntities();
+                    s_moving = false;
+                }));
+
+    const std::vector<size_t> order = shuffledIndices(count);
+    results.add("randomGetComponent", measure([&] {
+                    double sum = 0;
+                    for (const size_t i : order)
+                        sum += entities[i]->getComponent<position>()->x;
+                    s_sink = sum;
+                }));
+
+    results.add("addComponent", measure([&] {
+                    for (const auto &entity : entities)
+                        entity->addComponent<marker>();
+                    engine::application::updateEntities();
+                }));
+    // `entity::removeComponents_` doesn't erase marked components yet, so this measures the marking and the frame
+    results.add("removeComponent", measure([&] {
+                    for (const auto &entity : entities)
+                        entity->getComponent<marker>()->remove();
+                    engine::application::updateEntities();
+                }));
+
+    for (size_t i = 0; i < count / 2; i++)
+        entities[order[i]]->remove();
+    results.add("flushFragmented", measure([&] { engine::application::updateEntities(); }));
+
+    results.add("despawn", measure([&] {
+                    for (size_t i = count / 2; i < count; i++)
+                        entities[order[i]]->remove();
+                    engine::application::updateEntities();
+                }));
+}
+
+// comma separated sizes
+std::vector<size_t> parseSizes(const char *text)
+{
+    std::vector<size_t> result;
+    for (char *end; *text; text = *end ? end + 1 : end)
+    {
+        result.push_back(std::strtoull(text, &end, 10));
+        if (end == text)
+        {
+            std::fprintf(stderr, "invalid sizes: %s\n", text);
+            std::exit(1);
+        }
+    }
+    return result;
+}
+
+benchmarkOptions parseOptions(const int argc, char **argv)
+{
+    benchmarkOptions result;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string_view arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::fprintf(stderr, "missing value of %s\n", argv[i]);
+            std::exit(1);
+        }
+        const char *value = argv[++i];
+        if (arg == "--sizes")
+            result.sizes = parseSizes(value);
+        else if (arg == "--models")
+        {
+            const std::string_view models = value;
+            result.ecs = models.find("ecs") != std::string_view::npos;
+            result.entity = models.find("entity") != std::string_view::npos;
+        }
+        else if (arg == "--repeats")
+            result.repeats = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        else
+        {
+            std::fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            std::exit(1);
+        }
+    }
+    return result;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    const benchmarkOptions options = parseOptions(argc, argv);
+    std::printf("model,benchmark,entities,seconds,nsPerEntity\n");
+    for (const size_t count : options.sizes)
+    {
+        if (options.ecs)
+        {
+            benchmarkResults results;
+            for (size_t r = 0; r < options.repeats; r++)
+                benchmarkEcs(count, results);
+            results.print("ecs", count);
+        }
+        if (options.entity)
+        {
+            benchmarkResults results;
+            for (size_t r = 0; r < options.repeats; r++)
+                benchmarkEntity(count, results);
+            results.print("entity", count);
+        }
+    }
+    std::fprintf(stderr, "checksum %f\n", static_cast<double>(s_sink));
+}
@@ -1,4 +1,7 @@
 #pragma once
+#include <cstddef>
+#include <string_view>
+
 static constexpr size_t fnv1a_64_(const char *s, size_t count)
 {
     size_t hash = 0xcbf29ce484222325ULL;
@@ -22,4 +25,20 @@ static constexpr size_t getTypeHash_()
 #endif
     // compute FNV-1a over the full signature
     return fnv1a_64_(sig, sizeof(sig) / sizeof(char));
-}
\ No newline at end of file
+}
+
+// readable name of T, from the same signature
+template <typename T>
+static constexpr std::string_view getTypeName_()
+{
+#if defined(__clang__) || defined(__GNUC__)
+    constexpr std::string_view sig = __PRETTY_FUNCTION__;
+    constexpr size_t begin = sig.find("T = ") + 4;
+    constexpr size_t end = sig.find_first_of(";]", begin);
+#elif defined(_MSC_VER)
+    constexpr std::string_view sig = __FUNCSIG__;
+    constexpr size_t begin = sig.find("getTypeName_<") + 13;
+    constexpr size_t end = sig.rfind(">(void)");
+#endif
+    return sig.substr(begin, end - begin);
+}
@@ -1,12 +1,62 @@
 #pragma once
 #include "common/typeHash.hpp"
+#include "engine/flatHashMap.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <concepts>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <omp.h>
 #include <span>
 #include <stdlib.h>
-#include <unordered_map>
+#include <string_view>
+#include <tracy/Tracy.hpp>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace ecs
 {
+// opt-in for components that can be moved with a memcpy, skipping their move constructor and destructor (e.g.
+// ones owning a heap pointer). trivially copyable types always are
+template <typename T>
+inline constexpr bool isTriviallyRelocatable = std::is_trivially_copyable_v<T>;
+
+// alignment of a component inside its column. raise it to pad the row stride, e.g. 16 for a 12 byte vector so every
+// row can be loaded with aligned SIMD loads. column bases are always aligned to at least a cache line
+template <typename T>
+inline constexpr size_t componentAlignment = alignof(T);
+
+// opt-in for components that get added and removed often (flags like "stunned"): they live in a sparse set per type
+// beside the archetype tables, so adding or removing them never migrates the entity's row. queries join them per
+// entity. they can't be viewed as spans, used by `changed`/`added`/`anyOf`, spawned in batches, recorded in spawn
+// commands or saved in snapshots, and published snapshots leave them out
+template <typename T>
+inline constexpr bool isSparseComponent = false;
+
 // function traits
 namespace
 {
@@ -72,116 +122,318 @@ struct FunctionTraits<R (*)(Args...) noexcept> : FunctionTraits<R (*)(Args...)>
 // hash
 namespace
 {
-// map from full hash of components to individual hashes of components
-inline static std::unordered_map<size_t, std::vector<size_t>> _hashToSubHash;
-
-// get total hash of individual component hashes
-// assumes hashes are sorted (smallest at first and largest at last)
-static inline size_t getHash_(const std::vector<size_t> &hashes)
+// get total hash of individual component hashes. a single component's is its own hash
+// assumes hashes are sorted (largest at first and smallest at last). the worlds resolve collisions, see
+// `World::getOrCreateArchetype_`
+static constexpr size_t getHash_(const std::span<const size_t> hashes)
 {
     if (hashes.size() == 1)
-    {
-        _hashToSubHash.insert({hashes[0], {hashes[0]}});
         return hashes[0];
-    }
     size_t hash = 0xcbf29ce484222325ULL;
     for (size_t i = 0; i < hashes.size(); ++i)
     {
         hash ^= hashes[i];
         hash *= 0x100000001b3ULL;
     }
+    return hash;
+}
 
-    // update map
-    const auto &it = _hashToSubHash.find(hash);
-    if (it == _hashToSubHash.end())
-        _hashToSubHash.insert({hash, hashes});
+// empty components are tags: they're part of the archetype signature but have no column, so they cost nothing per
+// row. their constructors and destructors don't run per entity
+template <typename T>
+inline constexpr bool isTag_ = std::is_empty_v<T>;
 
-    return hash;
+// bytes between two rows of T's column. 0 for tags
+template <typename T>
+inline constexpr size_t componentStride_ = isTag_<T> ? 0 : (sizeof(T) + componentAlignment<T> - 1) & ~(componentAlignment<T> - 1);
+
+// what a tag's "column" points to. every row shares it
+static std::byte *getTagStorage_()
+{
+    alignas(64) static std::byte s_storage[64];
+    return s_storage;
 }
 
-// sub: child list
-// whole: super list
-// assumes both are sorted
-// O(N) where N is whole.size()
-static inline bool hashCollides_(const std::vector<size_t> &sub, const std::vector<size_t> &whole)
+// T inside a column
+template <typename T>
+static T *getColumnRow_(void *column, const size_t row)
 {
-    size_t s = 0;
-    for (size_t i = 0; i < whole.size(); i++)
-        if (whole[i] == sub[s])
+    return std::launder(reinterpret_cast<T *>(static_cast<std::byte *>(column) + row * componentStride_<T>));
+}
+
+// type-erased lifecycle of a component type, so columns can hold non-trivial components. every operation works on
+// `count` contiguous rows
+struct ComponentInfo
+{
+    size_t hash;
+
+    // dense index in registration order, the component's bit in `ComponentMask`s
+    uint32_t id;
+
+    std::string_view name;
+
+    // row stride (`componentStride_`)
+    size_t size;
+    size_t alignment;
+
+    // sizeof, less than the stride when `componentAlignment` pads the rows
+    size_t valueSize;
+
+    // moving is a memcpy and destroying does nothing
+    bool trivial;
+
+    // relocating (move then destroy the source) is a memcpy
+    bool relocatable;
+
+    void (*moveConstructFunc)(std::byte *destination, std::byte *source, size_t count);
+    void (*destroyFunc)(std::byte *components, size_t count);
+
+    // null when the component can't be copied
+    void (*copyConstructFunc)(std::byte *destination, const std::byte *source, size_t count);
+
+    // the source is left uninitialized
+    void moveConstruct(std::byte *destination, std::byte *source, const size_t count) const
+    {
+        if (trivial)
+            std::memcpy(destination, source, size * count);
+        else
+            moveConstructFunc(destination, source, count);
+    }
+
+    void destroy(std::byte *components, const size_t count) const
+    {
+        if (!trivial)
+            destroyFunc(components, count);
+    }
+
+    void relocate(std::byte *destination, std::byte *source, const size_t count) const
+    {
+        if (relocatable)
+            std::memcpy(destination, source, size * count);
+        else
         {
-            s++;
-            if (s == sub.size())
-                return true;
+            moveConstructFunc(destination, source, count);
+            destroyFunc(source, count);
         }
-    return false;
+    }
+};
+
+// most component types a program can register, the width of `ComponentMask`
+inline constexpr size_t maxComponentTypesCount = 256;
+
+// set of component ids, so matching an archetype is a few ANDs
+struct ComponentMask
+{
+    std::array<uint64_t, maxComponentTypesCount / 64> words{};
+
+    void set(const uint32_t id)
+    {
+        words[id / 64] |= uint64_t(1) << (id % 64);
+    }
+
+    bool test(const uint32_t id) const
+    {
+        return (words[id / 64] >> (id % 64)) & 1;
+    }
+
+    // whether every component of other is in this one
+    bool containsAll(const ComponentMask &other) const
+    {
+        uint64_t missing = 0;
+        for (size_t i = 0; i < words.size(); i++)
+            missing |= other.words[i] & ~words[i];
+        return missing == 0;
+    }
+
+    bool intersects(const ComponentMask &other) const
+    {
+        uint64_t common = 0;
+        for (size_t i = 0; i < words.size(); i++)
+            common |= words[i] & other.words[i];
+        return common != 0;
+    }
+
+    bool operator==(const ComponentMask &other) const = default;
+};
+
+static uint32_t createComponentId_()
+{
+    static std::atomic<uint32_t> s_nextId = 0;
+    const uint32_t id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+    if (id >= maxComponentTypesCount)
+    {
+        std::cerr << "usage error: more than " << maxComponentTypesCount << " component types were used" << std::endl;
+        abort();
+    }
+    return id;
 }
 
-static constexpr void sortHashesAndSizes__(std::vector<size_t> &hashes, std::vector<size_t> &sizes)
+// registered component infos by hash. archetypes only know their components' hashes
+static engine::flatHashMap<size_t, const ComponentInfo *> &getComponentInfos_()
 {
-    const size_t count = hashes.size();
-    // bubble sort
-    for (size_t i = 0; i < count - 1; i++)
-        for (size_t j = i + 1; j < count; j++)
-            if (hashes[j] > hashes[i])
-            {
-                std::swap(hashes[i], hashes[j]);
-                std::swap(sizes[i], sizes[j]);
-            }
+    static engine::flatHashMap<size_t, const ComponentInfo *> s_infos;
+    return s_infos;
+}
+
+static std::mutex &getComponentInfosMutex_()
+{
+    static std::mutex s_mutex;
+    return s_mutex;
+}
+
+// returns the info of T, registering it on first use
+template <typename T>
+static const ComponentInfo &getComponentInfo_()
+{
+    static_assert(componentAlignment<T> >= alignof(T) && (componentAlignment<T> & (componentAlignment<T> - 1)) == 0, "usage error: component alignment must be a power of two no less than alignof(T)");
+    static_assert(!isTag_<T> || alignof(T) <= 64, "usage error: tags can't be aligned beyond a cache line");
+    static const ComponentInfo s_info = [] {
+        ComponentInfo info{
+            getTypeHash_<T>(),
+            createComponentId_(),
+            getTypeName_<T>(),
+            componentStride_<T>,
+            componentAlignment<T>,
+            isTag_<T> ? 0 : sizeof(T),
+            std::is_trivially_copyable_v<T>,
+            isTriviallyRelocatable<T>,
+            [](std::byte *destination, std::byte *source, const size_t count) {
+                for (size_t i = 0; i < count; i++)
+                    new (destination + i * componentStride_<T>) T(std::move(*getColumnRow_<T>(source, i)));
+            },
+            [](std::byte *components, const size_t count) {
+                for (size_t i = 0; i < count; i++)
+                    std::destroy_at(getColumnRow_<T>(components, i));
+            },
+            nullptr};
+        if constexpr (std::is_copy_constructible_v<T>)
+            info.copyConstructFunc = [](std::byte *destination, const std::byte *source, const size_t count) {
+                for (size_t i = 0; i < count; i++)
+                    new (destination + i * componentStride_<T>) T(*getColumnRow_<T>(const_cast<std::byte *>(source), i));
+            };
+        return info;
+    }();
+    static const bool s_registered = [] {
+        std::lock_guard lock(getComponentInfosMutex_());
+        getComponentInfos_().insert({s_info.hash, &s_info});
+        return true;
+    }();
+    (void)s_registered;
+    return s_info;
+}
+
+// dense id of T, registering it on first use
+template <typename T>
+static uint32_t getComponentId_()
+{
+    return getComponentInfo_<T>().id;
+}
+
+// null when the component was never registered
+static const ComponentInfo *tryFindComponentInfo_(const size_t hash)
+{
+    std::lock_guard lock(getComponentInfosMutex_());
+    const auto &it = getComponentInfos_().find(hash);
+    return it != getComponentInfos_().end() ? it->second : nullptr;
+}
+
+static const ComponentInfo &findComponentInfo_(const size_t hash)
+{
+    const ComponentInfo *info = tryFindComponentInfo_(hash);
+    if (!info)
+    {
+        std::cerr << "usage error: component " << hash << " was never registered" << std::endl;
+        abort();
+    }
+    return *info;
 }
 
-static constexpr void ensureNeitherEqual__(std::vector<size_t> &hashes)
+// sorts both by the hashes, largest first
+template <size_t Count>
+static constexpr void sortHashesAndSizes__(std::array<size_t, Count> &hashes, std::array<size_t, Count> &sizes)
 {
-    for (size_t i = 0; i < hashes.size() - 1; i++)
-        if (hashes[i] == hashes[i + 1])
+    // insertion sort, Count is a handful of components
+    for (size_t i = 1; i < Count; i++)
+        for (size_t j = i; j > 0 && hashes[j] > hashes[j - 1]; j--)
         {
-            std::cerr << "usage error: duplicate component hashes found: " << hashes[i] << std::endl;
-            abort();
+            std::swap(hashes[j], hashes[j - 1]);
+            std::swap(sizes[j], sizes[j - 1]);
         }
 }
 
-// first: hashes second: sizes
+// sorted component hashes and sizes (row strides) of a set of component types, computed at compile time
 template <typename... Ts>
-static constexpr std::pair<std::vector<size_t>, std::vector<size_t>> createSortedHashesAndSizes_()
+struct ComponentSignature
 {
-    constexpr size_t count = sizeof...(Ts);
-    std::vector<size_t> hashes{getTypeHash_<Ts>()...};
-    std::vector<size_t> sizes{sizeof(Ts)...};
-    sortHashesAndSizes__(hashes, sizes);
-    ensureNeitherEqual__(hashes);
-    return {std::move(hashes), std::move(sizes)};
-}
+  private:
+    static constexpr std::pair<std::array<size_t, sizeof...(Ts)>, std::array<size_t, sizeof...(Ts)>> create_()
+    {
+        std::array<size_t, sizeof...(Ts)> hashes{getTypeHash_<Ts>()...};
+        std::array<size_t, sizeof...(Ts)> sizes{componentStride_<Ts>...};
+        sortHashesAndSizes__(hashes, sizes);
+        return {hashes, sizes};
+    }
+
+    static constexpr bool isUnique_()
+    {
+        for (size_t i = 1; i < sizeof...(Ts); i++)
+            if (hashes[i] == hashes[i - 1])
+                return false;
+        return true;
+    }
+
+  public:
+    static constexpr std::array<size_t, sizeof...(Ts)> hashes = create_().first;
+    static constexpr std::array<size_t, sizeof...(Ts)> sizes = create_().second;
+    static constexpr size_t hash = getHash_(hashes);
+
+    static_assert(isUnique_(), "usage error: duplicate components");
+};
 
 // first: hashes second: sizes
+// merges Ts' hashes into a sorted list that doesn't have them yet
 template <typename... Ts>
-static constexpr std::pair<std::vector<size_t>, std::vector<size_t>> createAppendedSortedHashesAndSizes_(const std::vector<size_t> &oldHashes, const std::vector<size_t> &oldSizes)
+static std::pair<std::vector<size_t>, std::vector<size_t>> createAppendedSortedHashesAndSizes_(const std::vector<size_t> &oldHashes, const std::vector<size_t> &oldSizes)
 {
+    using signature = ComponentSignature<Ts...>;
+    (..., getComponentInfo_<Ts>());
     std::vector<size_t> hashes;
     std::vector<size_t> sizes;
     hashes.reserve(oldHashes.size() + sizeof...(Ts));
     sizes.reserve(oldHashes.size() + sizeof...(Ts));
 
-    hashes.insert(hashes.end(), oldHashes.begin(), oldHashes.end());
-    sizes.insert(sizes.end(), oldSizes.begin(), oldSizes.end());
-
-    (..., hashes.push_back(getTypeHash_<Ts>()));
-    (..., sizes.push_back(sizeof(Ts)));
-
-    sortHashesAndSizes__(hashes, sizes);
-    ensureNeitherEqual__(hashes);
+    size_t i = 0, j = 0;
+    while (i < oldHashes.size() || j < sizeof...(Ts))
+    {
+        if (i < oldHashes.size() && j < sizeof...(Ts) && oldHashes[i] == signature::hashes[j])
+        {
+            std::cerr << "usage error: duplicate component hashes found: " << oldHashes[i] << std::endl;
+            abort();
+        }
+        if (j == sizeof...(Ts) || (i < oldHashes.size() && oldHashes[i] > signature::hashes[j]))
+        {
+            hashes.push_back(oldHashes[i]);
+            sizes.push_back(oldSizes[i++]);
+        }
+        else
+        {
+            hashes.push_back(signature::hashes[j]);
+            sizes.push_back(signature::sizes[j++]);
+        }
+    }
     return {std::move(hashes), std::move(sizes)};
 }
 
 // first: hashes second: sizes
 template <typename... Ts>
-static constexpr std::pair<std::vector<size_t>, std::vector<size_t>> createRemovedSortedHashesAndSizes_(const std::vector<size_t> &oldHashes, const std::vector<size_t> &oldSizes)
+static std::pair<std::vector<size_t>, std::vector<size_t>> createRemovedSortedHashesAndSizes_(const std::vector<size_t> &oldHashes, const std::vector<size_t> &oldSizes)
 {
     std::vector<size_t> hashes;
     std::vector<size_t> sizes;
-    hashes.reserve(oldHashes.size() - sizeof...(Ts));
-    sizes.reserve(oldHashes.size() - sizeof...(Ts));
-
-    const std::vector<size_t> removingHashes{getTypeHash_<Ts>()...};
+    hashes.reserve(oldHashes.size());
+    sizes.reserve(oldHashes.size());
 
+    constexpr auto &removingHashes = ComponentSignature<Ts...>::hashes;
     for (size_t i = 0; i < oldHashes.size(); i++)
         if (std::find(removingHashes.begin(), removingHashes.end(), oldHashes[i]) == removingHashes.end())
         {
@@ -190,431 +442,3710 @@ static constexpr std::pair<std::vector<size_t>, std::vector<size_t>> createRemov
         }
     return {std::move(hashes), std::move(sizes)};
 }
+
+// offsets of Ts when packed one after another in the given order, each aligned to its type. the last element is the
+// total size
+template <typename... Ts>
+static constexpr std::array<size_t, sizeof...(Ts) + 1> getPackedOffsets_()
+{
+    std::array<size_t, sizeof...(Ts) + 1> result{};
+    size_t i = 0, offset = 0;
+    (..., (offset = (offset + alignof(Ts) - 1) & ~(alignof(Ts) - 1), result[i++] = offset, offset += sizeof(Ts)));
+    result[i] = offset;
+    return result;
+}
+
+// key of a list of component types in the given order. used to cache archetype transitions
+template <typename... Ts>
+static constexpr size_t getTypesKey_()
+{
+    size_t hash = 0xcbf29ce484222325ULL;
+    (..., (hash ^= getTypeHash_<Ts>(), hash *= 0x100000001b3ULL));
+    return hash;
+}
+
+// hash of an archetype: its components' hash, mixed with its hierarchy depth below the roots
+static constexpr size_t getArchetypeHash_(const std::span<const size_t> hashes, const uint32_t depth)
+{
+    size_t hash = getHash_(hashes);
+    if (depth > 0)
+    {
+        hash ^= depth;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
 } // namespace
 
+// generational entity handle. stays valid across flushes until the entity is removed
 struct Entity
 {
-    const size_t rowIndex;
-    const size_t archetypeHash;
-    const size_t worldVer;
+    // index into the world's entity records
+    uint32_t index;
+
+    // incremented every time the index gets reused, so stale handles can be detected
+    uint32_t generation;
+
+    bool operator==(const Entity &other) const = default;
+};
+static_assert(sizeof(Entity) == 8);
+
+// never alive. `World::getParent` of a root
+inline constexpr Entity nullEntity{UINT32_MAX, UINT32_MAX};
+
+// entities with contiguous indices, created together by `World::addEntities`
+struct EntityRange
+{
+    uint32_t first;
+    uint32_t count;
+
+    // freshly created indices always start at generation 0
+    Entity operator[](const size_t i) const
+    {
+        return Entity{static_cast<uint32_t>(first + i), 0};
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+};
+
+// size in bytes of a single archetype chunk. every chunk holds all the columns of up to
+// `Archetype::rowsPerChunk` rows, so iterating one chunk keeps its working set inside L1/L2
+inline constexpr size_t chunkSize = 16 * 1024;
+
+// removed rows times columns from which a flush compacts an archetype's columns in parallel
+inline constexpr size_t parallelCompactionCount = 16 * 1024;
+
+// base alignment of every chunk allocation and every column inside it (one cache line). more for over-aligned
+// components
+inline constexpr size_t chunkAlignment = 64;
+
+// query term: matches entities without T
+template <typename T>
+struct without
+{
+};
+
+// query term: matches entities with at least one of Ts
+template <typename... Ts>
+struct anyOf
+{
+};
+
+// query term: T is not required. functions take it as a pointer (`T *`) which is null when it's missing
+template <typename T>
+struct optional
+{
+};
+
+// query term: requires T and skips the chunks where T wasn't mutably accessed since the query's last run
+// mutable access is a `T &`/`T *` function argument or `World::getComponent`
+template <typename T>
+struct changed
+{
 };
 
+// query term: requires T and skips the chunks where no T was added since the query's last run
+template <typename T>
+struct added
+{
+};
+
+struct World;
+
 namespace
 {
+struct Archetype;
+
+// no parent/child/sibling in the hierarchy links of `EntityRecord`
+inline constexpr uint32_t noEntityIndex = UINT32_MAX;
+
+// where an entity currently lives. indexed by `Entity::index`
+struct EntityRecord
+{
+    Archetype *archetype; // null when the index is free
+    size_t rowIndex;
+    uint32_t generation;
+
+    // removed since the last flush. the row and the generation are kept until then, so executions still visiting
+    // the row can read it
+    bool removed = false;
+
+    // hierarchy, as entity indices. children are a doubly linked list through their siblings
+    uint32_t parent = noEntityIndex;
+    uint32_t firstChild = noEntityIndex;
+    uint32_t nextSibling = noEntityIndex;
+    uint32_t previousSibling = noEntityIndex;
+};
+
 struct Archetype
 {
     const size_t hash;
-    const std::vector<size_t> componentHashes;
-    const std::vector<size_t> componentSizes;
-    const std::unordered_map<size_t, size_t> componentHashMap;
 
-    Archetype()
-        : hash(), componentHashMap(), componentHashes(), componentSizes(), _componentRows(), _toRemove()
+    // hierarchy depth of its entities (0 for roots). the same components at another depth are another archetype,
+    // so every depth is stored contiguously
+    const uint32_t depth;
+
+    const std::vector<size_t> componentHashes; // sorted, tags included
+    const std::vector<size_t> componentSizes;  // row strides, 0 for tags
+
+    // components stored in columns, which are all but the tags
+    const std::vector<size_t> columnHashes;
+    const std::vector<size_t> columnSizes;
+    const std::vector<const ComponentInfo *> columnInfos;
+
+    // component hash to its column index (`tagColumn` for tags)
+    const engine::flatHashMap<size_t, size_t> componentHashMap;
+
+    // ids of the components, tags included
+    const ComponentMask componentMask;
+
+    // component id to its column index, like `componentHashMap` but a direct index. sized to the largest id
+    const std::vector<size_t> componentIdColumns;
+
+    // max rows stored in a single chunk
+    const size_t rowsPerChunk;
+
+    // byte offset of each column inside a chunk. every chunk starts with the rows' `Entity` array
+    const std::vector<size_t> columnOffsets;
+
+    // allocation size and alignment of the chunks
+    const size_t chunkBytes;
+    const size_t alignment;
+
+    // cached transition to another archetype
+    struct Edge
     {
-    }
+        Archetype *target;
+
+        // target column index of each of this archetype's columns (`noColumn` if the component is dropped)
+        std::vector<size_t> columnMapping;
+
+        // target column index of each added component, in the order they were given
+        std::vector<size_t> addedColumns;
+    };
+
+    static constexpr size_t noColumn = (size_t)-1;
+
+    // the column index of tags. its pointers all point to a shared dummy, so typed code needs no special case
+    static constexpr size_t tagColumn = (size_t)-2;
+
+    // transitions when adding/removing components. keyed by `getTypesKey_`
+    engine::flatHashMap<size_t, Edge> addEdges;
+    engine::flatHashMap<size_t, Edge> removeEdges;
+
+    // transitions to the same components at another hierarchy depth. keyed by depth
+    engine::flatHashMap<uint32_t, Edge> depthEdges;
 
     // assumes hashes is sorted
-    Archetype(const std::vector<size_t> &hashes, const std::vector<size_t> &sizes)
-        : hash(getHash_(hashes)), componentHashMap(createComponentHashMap_(hashes)), componentSizes(sizes), componentHashes(hashes), _componentRows(), _toRemove()
+    Archetype(const std::vector<size_t> &hashes, const std::vector<size_t> &sizes, const uint32_t depth)
+        : hash(getArchetypeHash_(hashes, depth)), depth(depth), componentHashes(hashes), componentSizes(sizes), columnHashes(selectColumns_(hashes, sizes)), columnSizes(selectColumns_(sizes, sizes)), columnInfos(createComponentInfos_(columnHashes)), componentHashMap(createComponentHashMap_(hashes, sizes)), componentMask(createComponentMask_(hashes)), componentIdColumns(createComponentIdColumns_(componentHashMap)), rowsPerChunk(calculateRowsPerChunk_(columnSizes, columnInfos)), columnOffsets(createColumnOffsets_(columnSizes, columnInfos, rowsPerChunk)), chunkBytes(getLayoutSize_(columnSizes, columnInfos, rowsPerChunk)), alignment(getAlignment_(columnInfos)), _chunks(), _rowsCount(0), _toRemove(), _removalMarks()
     {
-        _componentRows.reserve(hashes.size());
-        for (size_t i = 0; i < hashes.size(); i++)
-            _componentRows.push_back({});
     }
 
+    Archetype(const Archetype &) = delete;
+    Archetype(Archetype &&) = delete;
+    Archetype &operator=(const Archetype &) = delete;
+    Archetype &operator=(Archetype &&) = delete;
+
+    ~Archetype()
+    {
+        // rows marked for removal are still alive
+        for (size_t c = 0; c < getChunksCount(); c++)
+            for (size_t i = 0; i < columnInfos.size(); i++)
+                columnInfos[i]->destroy(getChunkColumn(c, i), getChunkRowsCount(c));
+        for (size_t c = _adoptedChunksCount; c < _chunks.size(); c++)
+            freeChunk_(_chunks[c]);
+    }
+
+    // column index of a component or `noColumn` if this archetype doesn't have it
+    size_t findColumn(const size_t hash) const
+    {
+        const auto &it = componentHashMap.find(hash);
+        return it != componentHashMap.end() ? it->second : noColumn;
+    }
+
+    // `findColumn` by component id
+    size_t findColumnById(const uint32_t id) const
+    {
+        return id < componentIdColumns.size() ? componentIdColumns[id] : noColumn;
+    }
+
+    // empty for tags
     std::span<std::byte> getComponent(const size_t hash, const size_t rowIndex)
     {
         const size_t index = componentHashMap.at(hash);
-        const size_t size = componentSizes[index];
-        std::byte *ptr = _componentRows[index].data();
-        return std::span<std::byte>(ptr + size * rowIndex, size);
+        if (index == tagColumn)
+            return std::span<std::byte>();
+        return std::span<std::byte>(getComponentPtr(index, rowIndex), columnSizes[index]);
+    }
+
+    // pointer to a component by its column index
+    std::byte *getComponentPtr(const size_t columnIndex, const size_t rowIndex)
+    {
+        if (columnIndex == tagColumn)
+            return getTagStorage_();
+        std::byte *chunk = _chunks[rowIndex / rowsPerChunk];
+        return chunk + columnOffsets[columnIndex] + columnSizes[columnIndex] * (rowIndex % rowsPerChunk);
     }
 
     std::vector<std::span<std::byte>> getRow(const size_t rowIndex)
     {
         std::vector<std::span<std::byte>> result;
-        result.reserve(componentSizes.size());
-        for (size_t i = 0; i < componentSizes.size(); i++)
-        {
-            auto component = getComponent(componentHashes[i], rowIndex);
-            result.push_back(component);
-        }
+        result.reserve(columnSizes.size());
+        for (size_t i = 0; i < columnSizes.size(); i++)
+            result.push_back(std::span<std::byte>(getComponentPtr(i, rowIndex), columnSizes[i]));
         return result;
     }
 
-    // hashes' indices correspond to the components' indices
-    void add(const std::vector<std::span<std::byte>> &components, const std::vector<size_t> &hashes)
+    Entity getEntity(const size_t rowIndex) const
     {
-        // per component (not per row)
-        for (size_t i = 0; i < hashes.size(); i++)
-        {
-            const size_t hash = hashes[i];
-            const auto &addingRows = components[i];
+        return getChunkEntities(rowIndex / rowsPerChunk)[rowIndex % rowsPerChunk];
+    }
 
-            const size_t index = componentHashMap.at(hash);
-            const size_t size = componentSizes[index];
-            auto &rows = _componentRows[index];
+    // appends a row with uninitialized components and returns its index. all its components count as added
+    size_t addRow(const Entity entity, const size_t tick)
+    {
+        const size_t rowIndex = appendRow_(entity);
+        _rowsTicks[rowIndex / rowsPerChunk] = tick;
+        _createdCount++;
+        for (size_t i = 0; i < columnSizes.size(); i++)
+            markAdded_(rowIndex / rowsPerChunk, i, tick);
+        return rowIndex;
+    }
 
-            rows.reserve(rows.size() + addingRows.size());
-            rows.insert(rows.end(), addingRows.begin(), addingRows.end());
+    // appends the rows of fresh entities, ticks stamped once per chunk. the components are left uninitialized.
+    // returns the first row
+    size_t addRows(const EntityRange range, const size_t tick)
+    {
+        const size_t firstRow = _rowsCount;
+        for (size_t i = 0; i < range.size();)
+        {
+            if (_rowsCount == _chunks.size() * rowsPerChunk)
+                pushChunk_();
+            const size_t chunkIndex = _rowsCount / rowsPerChunk;
+            const size_t runCount = std::min(rowsPerChunk - _rowsCount % rowsPerChunk, range.size() - i);
+            Entity *entities = getChunkEntities(chunkIndex) + _rowsCount % rowsPerChunk;
+            for (size_t j = 0; j < runCount; j++)
+                entities[j] = range[i + j];
+            _rowsTicks[chunkIndex] = tick;
+            for (size_t c = 0; c < columnSizes.size(); c++)
+                markAdded_(chunkIndex, c, tick);
+            _rowsCount += runCount;
+            i += runCount;
         }
+        _createdCount += range.size();
+        return firstRow;
     }
 
-    void markForRemoval(const size_t rowIndex)
+    // copy-constructs contiguous components into an uninitialized column starting at a row, one copy per chunk
+    template <typename T>
+    void writeColumn(const size_t columnIndex, const size_t firstRow, const T *components, const size_t count)
     {
-        auto it = std::lower_bound(_toRemove.begin(), _toRemove.end(), rowIndex);
-        _toRemove.insert(it, rowIndex);
+        if constexpr (isTag_<T>)
+            return;
+        for (size_t row = firstRow; row < firstRow + count;)
+        {
+            const size_t runCount = std::min(rowsPerChunk - row % rowsPerChunk, firstRow + count - row);
+            std::byte *destination = getComponentPtr(columnIndex, row);
+            if constexpr (std::is_trivially_copyable_v<T> && componentStride_<T> == sizeof(T))
+                std::memcpy(destination, components + (row - firstRow), runCount * sizeof(T));
+            else
+                for (size_t i = 0; i < runCount; i++)
+                    new (destination + i * componentStride_<T>) T(components[row - firstRow + i]);
+            row += runCount;
+        }
     }
 
-    void flushMarks()
+    // allocates chunks up front for this many rows in total
+    void reserve(const size_t rowsCount)
     {
-        flushRemoves_();
+        const size_t chunksCount = (rowsCount + rowsPerChunk - 1) / rowsPerChunk;
+        _chunks.reserve(chunksCount);
+        while (_chunks.size() < chunksCount)
+            pushChunk_();
     }
 
-    size_t getRowsCount() const
+    // takes over chunks laid out `stride` bytes apart that hold `rowsCount` rows, all counting as added. they stay
+    // owned by the caller, which keeps them alive as long as this archetype. only on an empty archetype
+    void adoptChunks(std::byte *chunks, const size_t stride, const size_t rowsCount, const size_t tick)
     {
-        return _componentRows[0].size() / componentSizes[0];
+        const size_t chunksCount = (rowsCount + rowsPerChunk - 1) / rowsPerChunk;
+        _chunks.reserve(chunksCount);
+        for (size_t c = 0; c < chunksCount; c++)
+            _chunks.push_back(chunks + c * stride);
+        _adoptedChunksCount = chunksCount;
+        _rowsCount = rowsCount;
+        _createdCount += rowsCount;
+        _changedTicks.assign(chunksCount * columnSizes.size(), tick);
+        _addedTicks.assign(chunksCount * columnSizes.size(), tick);
+        _rowsTicks.assign(chunksCount, tick);
     }
 
-  private:
-    std::vector<std::vector<std::byte>> _componentRows;
-    std::vector<size_t> _toRemove; // sorted: least value at 0 largest at last
-
-    void flushRemoves_()
+    // moves a row of this archetype into a new row of the edge's target, column by column. returns the new row's index
+    // the added components' columns are left uninitialized. the moved-from row stays alive until it's flushed
+    size_t migrateRow(const size_t rowIndex, const Edge &edge, const size_t tick)
     {
-        if (_toRemove.size() == 0)
-            return;
-        // loop from largest-index to smallest-index
-        for (size_t i = _toRemove.size(); i-- > 0;)
-        {
-            const size_t deleteIndex = _toRemove[i];
-            for (size_t j = 0; j < _componentRows.size(); j++)
+        Archetype &target = *edge.target;
+        const size_t targetRowIndex = target.appendRow_(getEntity(rowIndex));
+        const size_t targetChunkIndex = targetRowIndex / target.rowsPerChunk;
+        target._rowsTicks[targetChunkIndex] = tick;
+        target._migratedInCount++;
+        _migratedOutCount++;
+        for (size_t i = 0; i < columnSizes.size(); i++)
+            if (edge.columnMapping[i] != noColumn)
             {
-                std::vector<std::byte> &rows = _componentRows[j];
-                const size_t size = componentSizes[j];
-                // swap index with the last
-                if (deleteIndex < rows.size() / size - 1)
-                    std::swap_ranges(
-                        /* first1 */ rows.begin() + deleteIndex * size,
-                        /* last1 */ rows.begin() + deleteIndex * size + size,
-                        /* first2 */ rows.end() - size);
-                rows.resize(rows.size() - size);
+                columnInfos[i]->moveConstruct(target.getComponentPtr(edge.columnMapping[i], targetRowIndex), getComponentPtr(i, rowIndex), 1);
+                // kept components are not new, they only carry over their source chunk's ticks
+                target.inheritTicks_(targetChunkIndex, edge.columnMapping[i], *this, rowIndex / rowsPerChunk, i);
             }
-        }
-
-        _toRemove.clear();
+        for (const size_t column : edge.addedColumns)
+            if (column != tagColumn)
+                target.markAdded_(targetChunkIndex, column, tick);
+        return targetRowIndex;
     }
 
-    static std::unordered_map<size_t, size_t> createComponentHashMap_(const std::vector<size_t> &hashes)
+    // O(1). returns whether this is the first mark since the last flush
+    bool markForRemoval(const size_t rowIndex)
     {
-        std::unordered_map<size_t, size_t> result;
-        result.reserve(hashes.size());
-        for (size_t i = 0; i < hashes.size(); i++)
-            result[hashes[i]] = i;
-        return result;
+        if (_removalMarks.size() <= rowIndex / 64)
+            _removalMarks.resize(std::max(rowIndex / 64 + 1, _removalMarks.size() * 2), 0);
+        const uint64_t bit = uint64_t(1) << (rowIndex % 64);
+        if (_removalMarks[rowIndex / 64] & bit)
+            return false;
+        _removalMarks[rowIndex / 64] |= bit;
+        _toRemove.push_back(rowIndex);
+        return _toRemove.size() == 1;
     }
 
-    template <typename T>
-    static constexpr std::vector<T> appendTwoVectors_(const std::vector<T> &vec1, const std::vector<T> &vec2)
+    // records of the moved rows get updated
+    void flushMarks(std::vector<EntityRecord> &records, const size_t tick)
     {
-        std::vector<T> result;
-        result.reserve(vec1.size() + vec2.size());
-        result.insert(result.end(), vec1.begin(), vec1.end());
-        result.insert(result.end(), vec1.begin(), vec1.end());
-        return result;
+        flushRemoves_(records, tick);
     }
-};
-} // namespace
-
-struct World
-{
-    // adds an entity right away
-    template <typename... Ts>
-    Entity addEntity(const Ts... components)
-    {
-        // find archetype
-        auto [hashes, sizes] = createSortedHashesAndSizes_<Ts...>();
-        auto &archetype = getOrCreateArchetype_(hashes, sizes);
-
-        // prepare components as byte vectors
-        const std::vector<size_t> unsortedHashes = {getTypeHash_<Ts>()...};
-        std::vector<std::span<std::byte>> componentsAsbytes;
-        componentsAsbytes.reserve(sizeof...(Ts));
-        auto callback = [&componentsAsbytes](auto &val) {
-            std::byte *ptr = (std::byte *)&val;
-            std::span<std::byte> bytes(ptr, sizeof(decltype(val)));
-            componentsAsbytes.push_back(std::move(bytes));
-        };
-        (..., callback(components));
 
-        archetype.add(componentsAsbytes, unsortedHashes);
-        return Entity{
-            .rowIndex = archetype.getRowsCount() - 1,
-            .archetypeHash = archetype.hash,
-            .worldVer = _ver};
+    size_t getRowsCount() const
+    {
+        return _rowsCount;
     }
 
-    // removes an entity. needs a flush
-    void removeEntity(const Entity &entity)
+    // chunks allocated, including the reserved ones past the last row
+    size_t getAllocatedChunksCount() const
     {
-        abortIfEntityNotUpdated_(entity);
-        auto &archetype = _archetypes.at(entity.archetypeHash);
-        archetype.markForRemoval(entity.rowIndex);
+        return _chunks.size();
     }
 
-    // executes tasks awaiting a flush
-    void flush()
+    // rows marked for removal since the last flush
+    size_t getPendingRemovalsCount() const
     {
-        while (_executingCount != 0)
-        {
-        }
-        for (auto &[_, archetype] : _archetypes)
-            archetype.flushMarks();
-        _ver++;
+        return _toRemove.size();
     }
 
-    // returns whether this entity contains this component type
-    template <typename T>
-    bool componentExists(const Entity &entity)
+    // rows added since this archetype's creation, by spawning or loading
+    size_t getCreatedCount() const
     {
-        abortIfEntityNotUpdated_(entity);
-        auto &archetype = _archetypes[entity.archetypeHash];
-        constexpr auto hash = getTypeHash_<T>();
-        return std::find(archetype.componentHashes.begin(), archetype.componentHashes.end(), hash) != archetype.componentHashes.end();
+        return _createdCount;
     }
 
-    // returns a component from this entity
-    // assumes component exists in this entity (no error checking)
-    template <typename T>
-    T &getComponent(const Entity &entity)
+    // rows moved in from/out to other archetypes since this archetype's creation
+    size_t getMigratedInCount() const
     {
-        abortIfEntityNotUpdated_(entity);
-        auto &archetype = _archetypes[entity.archetypeHash];
-        constexpr auto hash = getTypeHash_<T>();
-        auto asByte = archetype.getComponent(hash, entity.rowIndex);
-        return *(T *)asByte.data();
+        return _migratedInCount;
     }
 
-    // adds components to the entity. needs a flush
-    template <typename... Ts>
-    void addComponents(const Entity &entity, const Ts... components)
+    size_t getMigratedOutCount() const
     {
-        abortIfEntityNotUpdated_(entity);
-        auto &archetype = _archetypes.at(entity.archetypeHash);
-        archetype.markForRemoval(entity.rowIndex);
+        return _migratedOutCount;
+    }
 
-        // find target archetype
-        auto [hashes, sizes] = createAppendedSortedHashesAndSizes_<Ts...>(archetype.componentHashes, archetype.componentSizes);
-        auto &targetArchetype = getOrCreateArchetype_(hashes, sizes);
-
-        // add entity
-        auto row = archetype.getRow(entity.rowIndex);
-        row.reserve(row.size() + sizeof...(Ts));
-        auto callback = [&row](auto &val) {
-            std::byte *ptr = (std::byte *)&val;
-            std::span<std::byte> bytes(ptr, sizeof(decltype(val)));
-            row.push_back(std::move(bytes));
-        };
-        (..., callback(components));
-        std::vector<size_t> unsortedHashes;
-        unsortedHashes.reserve(hashes.size());
-        unsortedHashes.insert(unsortedHashes.end(), archetype.componentHashes.begin(), archetype.componentHashes.end());
-        (..., unsortedHashes.push_back(getTypeHash_<Ts>()));
+    // chunks holding at least one row
+    size_t getChunksCount() const
+    {
+        return (_rowsCount + rowsPerChunk - 1) / rowsPerChunk;
+    }
 
-        targetArchetype.add(row, unsortedHashes);
+    // rows used in this chunk. only the last used chunk can be partially filled
+    size_t getChunkRowsCount(const size_t chunkIndex) const
+    {
+        return std::min(rowsPerChunk, _rowsCount - chunkIndex * rowsPerChunk);
     }
 
-    // removes components from the entity. needs a flush
-    template <typename... Ts>
-    void removeComponents(const Entity &entity)
+    // a whole chunk, `chunkBytes` long
+    const std::byte *getChunkBytes(const size_t chunkIndex) const
     {
-        abortIfEntityNotUpdated_(entity);
-        auto &archetype = _archetypes.at(entity.archetypeHash);
-        archetype.markForRemoval(entity.rowIndex);
+        return _chunks[chunkIndex];
+    }
 
-        // find target archetype
-        auto [hashes, sizes] = createRemovedSortedHashesAndSizes_<Ts...>(archetype.componentHashes, archetype.componentSizes);
-        auto &targetArchetype = getOrCreateArchetype_(hashes, sizes);
+    Entity *getChunkEntities(const size_t chunkIndex) const
+    {
+        return reinterpret_cast<Entity *>(_chunks[chunkIndex]);
+    }
 
-        // add entity
-        auto row = archetype.getRow(entity.rowIndex);
-        std::vector<size_t> removingHashes{getTypeHash_<Ts>()...};
-        for (size_t i = row.size(); i-- > 0;)
-            if (std::find(removingHashes.begin(), removingHashes.end(), archetype.componentHashes[i]) != removingHashes.end())
-                row.erase(row.begin() + i);
+    // start of a column's contiguous array inside a chunk
+    std::byte *getChunkColumn(const size_t chunkIndex, const size_t columnIndex)
+    {
+        if (columnIndex == tagColumn)
+            return getTagStorage_();
+        return _chunks[chunkIndex] + columnOffsets[columnIndex];
+    }
 
-        targetArchetype.add(row, hashes);
+    // world tick of the last mutable access to a column in a chunk
+    size_t getChangedTick(const size_t chunkIndex, const size_t columnIndex) const
+    {
+        return _changedTicks[chunkIndex * columnSizes.size() + columnIndex];
+    }
+
+    // world tick of the last row added to a chunk (per column, since migrations only add some components)
+    size_t getAddedTick(const size_t chunkIndex, const size_t columnIndex) const
+    {
+        return _addedTicks[chunkIndex * columnSizes.size() + columnIndex];
+    }
+
+    void markChanged(const size_t chunkIndex, const size_t columnIndex, const size_t tick)
+    {
+        _changedTicks[chunkIndex * columnSizes.size() + columnIndex] = tick;
+    }
+
+    // world tick of the last write of any kind to a chunk: a mutable access, or rows added, moved or removed
+    size_t getWrittenTick(const size_t chunkIndex) const
+    {
+        size_t result = _rowsTicks[chunkIndex];
+        for (size_t i = 0; i < columnSizes.size(); i++)
+            result = std::max(result, getChangedTick(chunkIndex, i));
+        return result;
+    }
+
+  private:
+    std::vector<std::byte *> _chunks;
+    size_t _rowsCount;
+
+    // the first chunks can belong to someone else (`adoptChunks`) and are never freed here
+    size_t _adoptedChunksCount = 0;
+
+    size_t _createdCount = 0;
+    size_t _migratedInCount = 0;
+    size_t _migratedOutCount = 0;
+    std::vector<size_t> _toRemove; // in marking order, a flush rebuilds it in row order from the marks
+
+    // one bit per row, set for the rows in `_toRemove`
+    std::vector<uint64_t> _removalMarks;
+
+    // per chunk and column (`chunkIndex * columnsCount + columnIndex`)
+    std::vector<size_t> _changedTicks;
+    std::vector<size_t> _addedTicks;
+
+    // per chunk, world tick of the last row added, moved or removed
+    std::vector<size_t> _rowsTicks;
+
+    void pushChunk_()
+    {
+        _chunks.push_back(allocateChunk_());
+        _changedTicks.resize(_chunks.size() * columnSizes.size(), 0);
+        _addedTicks.resize(_chunks.size() * columnSizes.size(), 0);
+        _rowsTicks.resize(_chunks.size(), 0);
+    }
+
+    void popChunk_()
+    {
+        if (_chunks.size() > _adoptedChunksCount)
+            freeChunk_(_chunks.back());
+        else
+            _adoptedChunksCount--;
+        _chunks.pop_back();
+        _changedTicks.resize(_chunks.size() * columnSizes.size());
+        _addedTicks.resize(_chunks.size() * columnSizes.size());
+        _rowsTicks.resize(_chunks.size());
+    }
+
+    // appends a row with uninitialized components without touching the ticks
+    size_t appendRow_(const Entity entity)
+    {
+        // existing chunks are never moved, only a new one is appended when the last is full
+        if (_rowsCount == _chunks.size() * rowsPerChunk)
+            pushChunk_();
+        const size_t rowIndex = _rowsCount++;
+        getChunkEntities(rowIndex / rowsPerChunk)[rowIndex % rowsPerChunk] = entity;
+        return rowIndex;
+    }
+
+    void markAdded_(const size_t chunkIndex, const size_t columnIndex, const size_t tick)
+    {
+        _addedTicks[chunkIndex * columnSizes.size() + columnIndex] = tick;
+        _changedTicks[chunkIndex * columnSizes.size() + columnIndex] = tick;
+    }
+
+    // a row moved between chunks keeps the newest ticks of both, so no change gets lost
+    void inheritTicks_(const size_t chunkIndex, const size_t columnIndex, const Archetype &source, const size_t sourceChunkIndex, const size_t sourceColumnIndex)
+    {
+        const size_t index = chunkIndex * columnSizes.size() + columnIndex;
+        const size_t sourceIndex = sourceChunkIndex * source.columnSizes.size() + sourceColumnIndex;
+        _changedTicks[index] = std::max(_changedTicks[index], source._changedTicks[sourceIndex]);
+        _addedTicks[index] = std::max(_addedTicks[index], source._addedTicks[sourceIndex]);
+    }
+
+    bool isMarked_(const size_t rowIndex) const
+    {
+        return rowIndex / 64 < _removalMarks.size() && (_removalMarks[rowIndex / 64] & (uint64_t(1) << (rowIndex % 64)));
+    }
+
+    // compacts the table in one pass: the surviving rows past the new end fill the removed rows before it. every
+    // column is compacted on its own, in parallel when there is enough to move
+    void flushRemoves_(std::vector<EntityRecord> &records, const size_t tick)
+    {
+        if (_toRemove.size() == 0)
+            return;
+        const size_t newRowsCount = _rowsCount - _toRemove.size();
+
+        // in row order for sequential column accesses, by scanning the marks' words
+        _toRemove.clear();
+        for (size_t w = 0; w < _removalMarks.size(); w++)
+            for (uint64_t word = _removalMarks[w]; word != 0; word &= word - 1)
+                _toRemove.push_back(w * 64 + std::countr_zero(word));
+
+        // (hole, survivor) pairs. both sides have the same count
+        std::vector<std::pair<size_t, size_t>> moves;
+        size_t source = _rowsCount;
+        for (const size_t hole : _toRemove)
+        {
+            if (hole >= newRowsCount)
+                break;
+            while (isMarked_(--source))
+            {
+            }
+            moves.push_back({hole, source});
+        }
+
+        const signed long long columnsCount = columnInfos.size();
+#pragma omp parallel for schedule(dynamic, 1) if (_toRemove.size() * columnsCount >= parallelCompactionCount && !omp_in_parallel())
+        for (signed long long j = 0; j < columnsCount; j++)
+        {
+            const ComponentInfo &info = *columnInfos[j];
+            if (!info.trivial)
+                for (const size_t row : _toRemove)
+                    info.destroy(getComponentPtr(j, row), 1);
+            for (const auto &[hole, survivor] : moves)
+            {
+                info.relocate(getComponentPtr(j, hole), getComponentPtr(j, survivor), 1);
+                inheritTicks_(hole / rowsPerChunk, j, *this, survivor / rowsPerChunk, j);
+            }
+        }
+
+        for (const auto &[hole, survivor] : moves)
+        {
+            const Entity entity = getEntity(survivor);
+            getChunkEntities(hole / rowsPerChunk)[hole % rowsPerChunk] = entity;
+            _rowsTicks[hole / rowsPerChunk] = tick;
+
+            // the moved row may be a stale copy of an entity that has already migrated or been removed
+            EntityRecord &record = records[entity.index];
+            if (record.archetype == this && record.rowIndex == survivor && record.generation == entity.generation)
+                record.rowIndex = hole;
+        }
+
+        std::fill(_removalMarks.begin(), _removalMarks.end(), 0);
+        _toRemove.clear();
+        _rowsCount = newRowsCount;
+
+        // release the chunks that became empty
+        while (_chunks.size() > getChunksCount())
+            popChunk_();
+    }
+
+    std::byte *allocateChunk_() const
+    {
+        return static_cast<std::byte *>(::operator new(chunkBytes, std::align_val_t{alignment}));
+    }
+
+    void freeChunk_(std::byte *chunk) const
+    {
+        ::operator delete(chunk, std::align_val_t{alignment});
+    }
+
+    static size_t getColumnAlignment_(const ComponentInfo &info)
+    {
+        return std::max(chunkAlignment, info.alignment);
+    }
+
+    static size_t getAlignment_(const std::vector<const ComponentInfo *> &infos)
+    {
+        size_t result = chunkAlignment;
+        for (const ComponentInfo *info : infos)
+            result = std::max(result, getColumnAlignment_(*info));
+        return result;
+    }
+
+    // bytes used by a chunk of this many rows
+    static size_t getLayoutSize_(const std::vector<size_t> &sizes, const std::vector<const ComponentInfo *> &infos, const size_t rowsCount)
+    {
+        size_t offset = sizeof(Entity) * rowsCount;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            const size_t columnAlignment = getColumnAlignment_(*infos[i]);
+            offset = (offset + columnAlignment - 1) & ~(columnAlignment - 1);
+            offset += sizes[i] * rowsCount;
+        }
+        return offset;
+    }
+
+    static size_t calculateRowsPerChunk_(const std::vector<size_t> &sizes, const std::vector<const ComponentInfo *> &infos)
+    {
+        // estimate without the padding between columns, then shrink until the padding fits too
+        size_t rowSize = sizeof(Entity);
+        for (size_t i = 0; i < sizes.size(); i++)
+            rowSize += sizes[i];
+        size_t rowsCount = std::max<size_t>(1, chunkSize / rowSize);
+        while (rowsCount > 1 && getLayoutSize_(sizes, infos, rowsCount) > chunkSize)
+            rowsCount--;
+        return rowsCount;
+    }
+
+    // columns are laid out one after another, each starting at a cache line (or its component's alignment)
+    static std::vector<size_t> createColumnOffsets_(const std::vector<size_t> &sizes, const std::vector<const ComponentInfo *> &infos, const size_t rowsPerChunk)
+    {
+        std::vector<size_t> result;
+        result.reserve(sizes.size());
+        size_t offset = sizeof(Entity) * rowsPerChunk;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            const size_t columnAlignment = getColumnAlignment_(*infos[i]);
+            offset = (offset + columnAlignment - 1) & ~(columnAlignment - 1);
+            result.push_back(offset);
+            offset += sizes[i] * rowsPerChunk;
+        }
+        return result;
+    }
+
+    static ComponentMask createComponentMask_(const std::vector<size_t> &hashes)
+    {
+        ComponentMask result;
+        for (const size_t hash : hashes)
+            result.set(findComponentInfo_(hash).id);
+        return result;
+    }
+
+    static std::vector<size_t> createComponentIdColumns_(const engine::flatHashMap<size_t, size_t> &hashMap)
+    {
+        std::vector<size_t> result;
+        for (const auto &[hash, column] : hashMap)
+        {
+            const uint32_t id = findComponentInfo_(hash).id;
+            if (id >= result.size())
+                result.resize(id + 1, noColumn);
+            result[id] = column;
+        }
+        return result;
+    }
+
+    static std::vector<const ComponentInfo *> createComponentInfos_(const std::vector<size_t> &hashes)
+    {
+        std::vector<const ComponentInfo *> result;
+        result.reserve(hashes.size());
+        for (const size_t hash : hashes)
+            result.push_back(&findComponentInfo_(hash));
+        return result;
+    }
+
+    // the values of the components with a column (non-zero size)
+    static std::vector<size_t> selectColumns_(const std::vector<size_t> &values, const std::vector<size_t> &sizes)
+    {
+        std::vector<size_t> result;
+        for (size_t i = 0; i < values.size(); i++)
+            if (sizes[i] != 0)
+                result.push_back(values[i]);
+        return result;
+    }
+
+    static engine::flatHashMap<size_t, size_t> createComponentHashMap_(const std::vector<size_t> &hashes, const std::vector<size_t> &sizes)
+    {
+        engine::flatHashMap<size_t, size_t> result;
+        result.reserve(hashes.size());
+        size_t column = 0;
+        for (size_t i = 0; i < hashes.size(); i++)
+            result[hashes[i]] = sizes[i] != 0 ? column++ : tagColumn;
+        return result;
+    }
+};
+
+// a sparse component type's values packed densely, plus each entity index's position among them
+struct SparseStorage
+{
+    static constexpr uint32_t noPosition = UINT32_MAX;
+
+    // entity of each value
+    std::vector<Entity> entities;
+
+    // indexed by entity index
+    std::vector<uint32_t> positions;
+
+    virtual ~SparseStorage() = default;
+
+    // no-op when the entity has no value
+    virtual void remove(const uint32_t entityIndex) = 0;
+
+    virtual void clear() = 0;
+
+    // null when the entity has no value
+    virtual void *find(const uint32_t entityIndex) = 0;
+
+    bool contains(const uint32_t entityIndex) const
+    {
+        return entityIndex < positions.size() && positions[entityIndex] != noPosition;
+    }
+
+    size_t size() const
+    {
+        return entities.size();
+    }
+};
+
+template <typename T>
+struct SparseSet : SparseStorage
+{
+    std::vector<T> values;
+
+    // replaces the entity's value if it has one
+    void insert(const Entity entity, T &&value)
+    {
+        if (entity.index >= positions.size())
+            positions.resize(entity.index + 1, noPosition);
+        uint32_t &position = positions[entity.index];
+        if (position != noPosition)
+        {
+            values[position] = std::move(value);
+            return;
+        }
+        position = static_cast<uint32_t>(entities.size());
+        entities.push_back(entity);
+        values.push_back(std::move(value));
+    }
+
+    // the last value fills the gap
+    void remove(const uint32_t entityIndex) override
+    {
+        if (!contains(entityIndex))
+            return;
+        const uint32_t position = positions[entityIndex];
+        const uint32_t last = static_cast<uint32_t>(entities.size() - 1);
+        if (position != last)
+        {
+            values[position] = std::move(values[last]);
+            entities[position] = entities[last];
+            positions[entities[position].index] = position;
+        }
+        values.pop_back();
+        entities.pop_back();
+        positions[entityIndex] = noPosition;
+    }
+
+    void clear() override
+    {
+        values.clear();
+        entities.clear();
+        positions.clear();
+    }
+
+    void *find(const uint32_t entityIndex) override
+    {
+        return contains(entityIndex) ? &values[positions[entityIndex]] : nullptr;
+    }
+
+    // assumes the entity has a value
+    T &get(const uint32_t entityIndex)
+    {
+        return values[positions[entityIndex]];
+    }
+};
+
+// archetype matching rules of a query's terms
+struct QuerySignature
+{
+    ComponentMask required;
+    ComponentMask excluded;
+    std::vector<ComponentMask> anyOf; // at least one of each group is required
+    std::vector<uint32_t> changedIds;
+    std::vector<uint32_t> addedIds;
+
+    // sparse components are matched per entity, not per archetype
+    std::vector<uint32_t> sparseRequiredIds;
+    std::vector<uint32_t> sparseExcludedIds;
+
+    bool matches(const Archetype &archetype) const
+    {
+        const ComponentMask &mask = archetype.componentMask;
+        if (!mask.containsAll(required) || mask.intersects(excluded))
+            return false;
+        for (const ComponentMask &group : anyOf)
+            if (!mask.intersects(group))
+                return false;
+        return true;
+    }
+
+    // whether a chunk of a matching archetype passes the `changed`/`added` terms
+    bool matchesChunk(const Archetype &archetype, const size_t chunkIndex, const size_t lastRunTick) const
+    {
+        for (const uint32_t id : changedIds)
+            if (archetype.getChangedTick(chunkIndex, archetype.findColumnById(id)) <= lastRunTick)
+                return false;
+        for (const uint32_t id : addedIds)
+            if (archetype.getAddedTick(chunkIndex, archetype.findColumnById(id)) <= lastRunTick)
+                return false;
+        return true;
+    }
+
+    bool hasChunkTerms() const
+    {
+        return changedIds.size() > 0 || addedIds.size() > 0;
+    }
+
+    // the same rules, whatever order their terms were given in
+    bool hasSameRules(const QuerySignature &other) const
+    {
+        auto sameElements = [](const auto &a, const auto &b) {
+            return a.size() == b.size() && std::all_of(a.begin(), a.end(), [&](const auto &element) { return std::find(b.begin(), b.end(), element) != b.end(); });
+        };
+        return required == other.required && excluded == other.excluded && sameElements(anyOf, other.anyOf) && sameElements(changedIds, other.changedIds) && sameElements(addedIds, other.addedIds) &&
+               sameElements(sparseRequiredIds, other.sparseRequiredIds) && sameElements(sparseExcludedIds, other.sparseExcludedIds);
+    }
+};
+
+// archetypes matching a signature. kept up to date as new archetypes get created
+struct QueryState
+{
+    const size_t hash;
+    const QuerySignature signature;
+    std::vector<Archetype *> archetypes;
+
+    // world tick of the last execution through `World::execute` (`Query` handles keep their own)
+    size_t lastRunTick = 0;
+
+    // sets of the signature's sparse ids, created with the state
+    std::vector<SparseStorage *> sparseRequired{};
+    std::vector<SparseStorage *> sparseExcluded{};
+
+    bool hasSparseTerms() const
+    {
+        return sparseRequired.size() > 0 || sparseExcluded.size() > 0;
+    }
+
+    // whether an entity of a matching archetype passes the sparse terms
+    bool matchesSparse(const uint32_t entityIndex) const
+    {
+        for (const SparseStorage *set : sparseRequired)
+            if (!set->contains(entityIndex))
+                return false;
+        for (const SparseStorage *set : sparseExcluded)
+            if (set->contains(entityIndex))
+                return false;
+        return true;
+    }
+};
+
+// how a query term affects the signature
+// component is the type whose sparse set the term needs, if it's sparse
+template <typename T>
+struct QueryTerm
+{
+    using component = T;
+    static constexpr bool isRequired = true;
+    static constexpr size_t requiredHash = getTypeHash_<T>();
+
+    static void addTo(QuerySignature &signature)
+    {
+        if constexpr (isSparseComponent<T>)
+            signature.sparseRequiredIds.push_back(getComponentId_<T>());
+        else
+            signature.required.set(getComponentId_<T>());
+    }
+};
+
+template <typename T>
+struct QueryTerm<optional<T>>
+{
+    using component = T;
+    static constexpr bool isRequired = false;
+    static constexpr size_t requiredHash = 0;
+
+    static void addTo(QuerySignature &)
+    {
+    }
+};
+
+template <typename T>
+struct QueryTerm<without<T>>
+{
+    using component = T;
+    static constexpr bool isRequired = false;
+    static constexpr size_t requiredHash = 0;
+
+    static void addTo(QuerySignature &signature)
+    {
+        if constexpr (isSparseComponent<T>)
+            signature.sparseExcludedIds.push_back(getComponentId_<T>());
+        else
+            signature.excluded.set(getComponentId_<T>());
+    }
+};
+
+template <typename... Ts>
+struct QueryTerm<anyOf<Ts...>>
+{
+    static_assert(!(... || isSparseComponent<Ts>), "usage error: sparse components can't be in `anyOf`");
+
+    using component = void;
+    static constexpr bool isRequired = false;
+    static constexpr size_t requiredHash = 0;
+
+    static void addTo(QuerySignature &signature)
+    {
+        ComponentMask &group = signature.anyOf.emplace_back();
+        (..., group.set(getComponentId_<Ts>()));
+    }
+};
+
+template <typename T>
+struct QueryTerm<changed<T>>
+{
+    static_assert(!isTag_<T>, "usage error: tags have no change detection");
+    static_assert(!isSparseComponent<T>, "usage error: sparse components have no change detection");
+
+    using component = T;
+    static constexpr bool isRequired = true;
+    static constexpr size_t requiredHash = getTypeHash_<T>();
+
+    static void addTo(QuerySignature &signature)
+    {
+        signature.required.set(getComponentId_<T>());
+        signature.changedIds.push_back(getComponentId_<T>());
+    }
+};
+
+template <typename T>
+struct QueryTerm<added<T>>
+{
+    static_assert(!isTag_<T>, "usage error: tags have no change detection");
+    static_assert(!isSparseComponent<T>, "usage error: sparse components have no change detection");
+
+    using component = T;
+    static constexpr bool isRequired = true;
+    static constexpr size_t requiredHash = getTypeHash_<T>();
+
+    static void addTo(QuerySignature &signature)
+    {
+        signature.required.set(getComponentId_<T>());
+        signature.addedIds.push_back(getComponentId_<T>());
+    }
+};
+
+// whether a term can be given as a filter to `World::execute`
+template <typename T>
+inline constexpr bool isFilterTerm_ = false;
+template <typename T>
+inline constexpr bool isFilterTerm_<without<T>> = true;
+template <typename... Ts>
+inline constexpr bool isFilterTerm_<anyOf<Ts...>> = true;
+template <typename T>
+inline constexpr bool isFilterTerm_<changed<T>> = true;
+template <typename T>
+inline constexpr bool isFilterTerm_<added<T>> = true;
+
+template <typename... Terms>
+static QuerySignature createQuerySignature_()
+{
+    QuerySignature signature;
+    (..., QueryTerm<Terms>::addTo(signature));
+    return signature;
+}
+
+// function argument to component mapping. pointer arguments are optional components
+template <typename Arg>
+struct ArgTraits
+{
+    using component = std::remove_cvref_t<Arg>;
+    using term = component;
+
+    // whether the function can write to the component
+    static constexpr bool writes = std::is_lvalue_reference_v<Arg> && !std::is_const_v<std::remove_reference_t<Arg>>;
+
+    static Arg get(void *column, const size_t row)
+    {
+        return *getColumnRow_<component>(column, row);
+    }
+};
+
+template <typename T>
+struct ArgTraits<T *>
+{
+    using component = std::remove_const_t<T>;
+    using term = optional<component>;
+
+    static constexpr bool writes = !std::is_const_v<T>;
+
+    static T *get(void *column, const size_t row)
+    {
+        return column ? getColumnRow_<component>(column, row) : nullptr;
+    }
+};
+
+// contiguous rows of a column, for `World::executeChunks`
+template <typename T>
+struct ArgTraits<std::span<T>>
+{
+    using component = std::remove_const_t<T>;
+    using term = component;
+
+    static constexpr bool writes = !std::is_const_v<T>;
+
+    static std::span<T> get(void *column, const size_t begin, const size_t end)
+    {
+        static_assert(componentStride_<component> == sizeof(component), "usage error: tags and components with a padded stride can't be viewed as spans");
+        static_assert(!isSparseComponent<component>, "usage error: sparse components can't be viewed as spans");
+        return std::span<T>(getColumnRow_<component>(column, begin), end - begin);
+    }
+};
+
+// a function argument of one row, from its column or, for sparse components, from the entity's value in their set
+template <typename Arg>
+static Arg getArg_(void *column, const size_t row, SparseStorage *sparseSet, const Entity &entity)
+{
+    if constexpr (isSparseComponent<typename ArgTraits<Arg>::component>)
+        return ArgTraits<Arg>::get(sparseSet ? sparseSet->find(entity.index) : nullptr, 0);
+    else
+        return ArgTraits<Arg>::get(column, row);
+}
+
+template <typename T>
+inline constexpr bool isSpan_ = false;
+template <typename T>
+inline constexpr bool isSpan_<std::span<T>> = true;
+
+template <typename Args>
+inline constexpr bool isSpanArgs_ = false;
+template <typename... Args>
+inline constexpr bool isSpanArgs_<std::tuple<Args...>> = (... && isSpan_<std::remove_cvref_t<Args>>);
+
+// whether every argument of a function is a span
+template <typename Func>
+inline constexpr bool isSpanFunction_ = isSpanArgs_<typename FunctionTraits<std::decay_t<Func>>::args>;
+
+template <typename T, typename... Ts>
+inline constexpr bool isOneOf_ = (std::is_same_v<T, Ts> || ...);
+
+// whether every (non-entity) argument of a function is one of Ts (as a required or optional term)
+template <typename Args, typename... Ts>
+struct ArgsInComponents;
+
+template <typename... Args, typename... Ts>
+struct ArgsInComponents<std::tuple<Args...>, Ts...>
+{
+    static constexpr bool value = (... && (isOneOf_<typename ArgTraits<Args>::component, Entity, Ts...> || isOneOf_<typename ArgTraits<Args>::term, Ts...> || isOneOf_<changed<typename ArgTraits<Args>::component>, Ts...> || isOneOf_<added<typename ArgTraits<Args>::component>, Ts...>));
+};
+
+// components of a recorded spawn or component addition. computed once per components list
+struct SpawnInfo
+{
+    // of the root archetype of the components, whatever their order
+    const size_t hash;
+
+    const std::vector<size_t> hashes;  // sorted
+    const std::vector<size_t> sizes;   // sorted
+    const std::vector<size_t> offsets; // payload offset of each component, in sorted order
+    const std::vector<const ComponentInfo *> infos; // sorted
+
+    // of the payload, the largest alignment of the components
+    const size_t alignment;
+
+    // every component is trivial, so payloads can be moved as bytes and need no destruction
+    const bool trivial;
+
+    // moves a payload to uninitialized memory
+    void relocate(std::byte *destination, std::byte *source) const
+    {
+        for (size_t i = 0; i < infos.size(); i++)
+            infos[i]->relocate(destination + offsets[i], source + offsets[i], 1);
+    }
+
+    void destroy(std::byte *payload) const
+    {
+        for (size_t i = 0; i < infos.size(); i++)
+            infos[i]->destroy(payload + offsets[i], 1);
+    }
+};
+
+template <typename... Ts>
+static const SpawnInfo &getSpawnInfo_()
+{
+    static const SpawnInfo s_info = [] {
+        using signature = ComponentSignature<Ts...>;
+        (..., getComponentInfo_<Ts>());
+        std::vector<size_t> hashes(signature::hashes.begin(), signature::hashes.end());
+        std::vector<size_t> sizes(signature::sizes.begin(), signature::sizes.end());
+        constexpr auto packedOffsets = getPackedOffsets_<Ts...>();
+        constexpr size_t unsortedHashes[]{getTypeHash_<Ts>()...};
+        std::vector<size_t> offsets(hashes.size());
+        for (size_t i = 0; i < hashes.size(); i++)
+            for (size_t j = 0; j < sizeof...(Ts); j++)
+                if (unsortedHashes[j] == hashes[i])
+                    offsets[i] = packedOffsets[j];
+        std::vector<const ComponentInfo *> infos;
+        for (const size_t hash : hashes)
+            infos.push_back(&findComponentInfo_(hash));
+        return SpawnInfo{signature::hash, std::move(hashes), std::move(sizes), std::move(offsets), std::move(infos), std::max({alignof(Ts)...}), (... && std::is_trivially_copyable_v<Ts>)};
+    }();
+    return s_info;
+}
+
+enum class CommandType : uint8_t
+{
+    addEntity,
+    removeEntity,
+    migrate
+};
+
+// header of a recorded command. its components payload follows it in the arena
+struct Command
+{
+    CommandType type;
+
+    // bytes from the header to its payload, which is aligned to its components
+    uint8_t payloadOffset;
+
+    // bytes of this command including the payload
+    uint32_t size;
+
+    // target of removeEntity/migrate
+    Entity entity;
+
+    // layout of the payload. null when there is none or it's plain bytes
+    const SpawnInfo *spawnInfo;
+
+    // migrate only (add/remove components). moves the components out of the payload
+    void (*migrate)(World &world, const Entity &entity, std::byte *payload);
+
+    // migrate only, the edge of a table add/remove from the entity's archetype so playback can group the commands by
+    // destination. null for sparse components and parent changes, which go through `migrate`
+    const Archetype::Edge &(*resolve)(World &world, Archetype &archetype);
+
+    std::byte *getPayload()
+    {
+        return reinterpret_cast<std::byte *>(this) + payloadOffset;
+    }
+};
+
+// most alignment a recorded component can have
+inline constexpr size_t commandAlignment = chunkAlignment;
+
+// cache line aligned allocations, so command payloads can keep over-aligned components
+template <typename T>
+struct CacheAlignedAllocator
+{
+    using value_type = T;
+
+    CacheAlignedAllocator() = default;
+
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &)
+    {
+    }
+
+    T *allocate(const size_t count)
+    {
+        return static_cast<T *>(::operator new(count * sizeof(T), std::align_val_t{commandAlignment}));
+    }
+
+    void deallocate(T *ptr, const size_t)
+    {
+        ::operator delete(ptr, std::align_val_t{commandAlignment});
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U> &) const
+    {
+        return true;
+    }
+};
+
+// rows [begin, end) of one chunk, the unit of work of parallel executions
+struct ParallelTask
+{
+    Archetype *archetype;
+    size_t chunkIndex;
+    size_t begin;
+    size_t end;
+
+    // whether it marks the chunk as written. one task per chunk does
+    bool stamp;
+};
+
+// a thread's remaining task range. the owner pops from the front and thieves take the back half
+struct alignas(64) ParallelWorker
+{
+    // next task in the low 32 bits, end in the high 32 bits
+    std::atomic<uint64_t> range;
+    size_t stealsCount;
+
+    // seconds from the start of the execution until this thread ran out of work
+    double busyTime;
+
+    static uint64_t pack(const size_t begin, const size_t end)
+    {
+        return static_cast<uint64_t>(begin) | (static_cast<uint64_t>(end) << 32);
+    }
+
+    void set(const size_t begin, const size_t end)
+    {
+        range.store(pack(begin, end), std::memory_order_release);
+    }
+
+    bool popFront(size_t &task)
+    {
+        uint64_t r = range.load(std::memory_order_acquire);
+        while (true)
+        {
+            const size_t begin = r & 0xffffffff, end = r >> 32;
+            if (begin >= end)
+                return false;
+            if (range.compare_exchange_weak(r, pack(begin + 1, end), std::memory_order_acq_rel))
+            {
+                task = begin;
+                return true;
+            }
+        }
+    }
+
+    bool stealBack(size_t &begin, size_t &end)
+    {
+        uint64_t r = range.load(std::memory_order_acquire);
+        while (true)
+        {
+            const size_t b = r & 0xffffffff, e = r >> 32;
+            if (b >= e)
+                return false;
+            const size_t middle = e - (e - b + 1) / 2;
+            if (range.compare_exchange_weak(r, pack(b, middle), std::memory_order_acq_rel))
+            {
+                begin = middle;
+                end = e;
+                return true;
+            }
+        }
+    }
+};
+
+// per calling thread so concurrent executions don't share their scratch
+struct ParallelContext
+{
+    std::vector<ParallelTask> tasks;
+    std::unique_ptr<ParallelWorker[]> workers;
+    size_t workersCount = 0;
+
+    static ParallelContext &get()
+    {
+        thread_local ParallelContext context;
+        return context;
+    }
+};
+
+// snapshot file offsets of chunk data are multiples of it, so mapped chunks keep their alignment
+inline constexpr size_t snapshotPageSize = 4096;
+
+inline constexpr uint64_t snapshotMagic = 0x31504e5353434500ULL; // "\0ECSSNP1"
+inline constexpr uint32_t snapshotVersion = 1;
+
+// `World::saveSnapshot` file layout: this header, every archetype's descriptor followed by its component hashes and
+// sizes, the entity records, the free entity indices, then every archetype's chunks exactly as they are in memory,
+// starting at page aligned offsets, so loading can map them in place
+struct SnapshotHeader
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t archetypesCount;
+    uint64_t recordsCount;
+    uint64_t freeIndicesCount;
+};
+
+struct SnapshotArchetype
+{
+    uint64_t componentsCount;
+    uint64_t rowsCount;
+
+    // must match the loading build's layout of the same components
+    uint64_t rowsPerChunk;
+    uint64_t chunkBytes;
+
+    // bytes between two chunks, `chunkBytes` rounded up to the archetype's alignment
+    uint64_t chunkStride;
+    uint64_t dataOffset;
+    uint32_t depth;
+    uint32_t padding;
+};
+
+struct SnapshotRecord
+{
+    uint32_t archetype; // descriptor index, `noEntityIndex` when the index is free
+    uint32_t generation;
+    uint64_t rowIndex;
+    uint32_t parent;
+    uint32_t firstChild;
+    uint32_t nextSibling;
+    uint32_t previousSibling;
+};
+
+// a whole file mapped copy-on-write: its pages can be written without touching the file
+struct MappedFile
+{
+    std::byte *data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+        if (!data)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+    }
+
+    // null when the file can't be mapped
+    static std::unique_ptr<MappedFile> open(const std::filesystem::path &path)
+    {
+        auto result = std::make_unique<MappedFile>();
+#ifdef _WIN32
+        const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return nullptr;
+        LARGE_INTEGER size;
+        const HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr) : nullptr;
+        CloseHandle(file);
+        if (!mapping)
+            return nullptr;
+        // the view keeps the mapping alive
+        result->data = static_cast<std::byte *>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+        CloseHandle(mapping);
+        if (!result->data)
+            return nullptr;
+        result->size = static_cast<size_t>(size.QuadPart);
+#else
+        const int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return nullptr;
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size == 0)
+        {
+            close(file);
+            return nullptr;
+        }
+        void *data = mmap(nullptr, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        close(file);
+        if (data == MAP_FAILED)
+            return nullptr;
+        // start reading ahead, the chunks get touched soon
+        madvise(data, status.st_size, MADV_WILLNEED);
+        result->data = static_cast<std::byte *>(data);
+        result->size = static_cast<size_t>(status.st_size);
+#endif
+        return result;
+    }
+};
+
+// what published snapshots need of an archetype, so they can outlive it
+struct PublishedLayout
+{
+    // component hash to its column's byte offset in a chunk (`tagOffset` for tags)
+    engine::flatHashMap<size_t, size_t> columnOffsets;
+
+    // byte offsets of the columns that can't be copied as bytes, with their components' infos
+    std::vector<std::pair<size_t, const ComponentInfo *>> nonTrivialColumns;
+
+    static constexpr size_t tagOffset = (size_t)-1;
+};
+
+// immutable copy of an archetype chunk, shared by every published snapshot it wasn't written in between. the rows of
+// non-trivial columns are copy-constructed, so the copy owns their resources
+struct PublishedChunk
+{
+    std::byte *bytes;
+    size_t rowsCount;
+    size_t alignment;
+    std::shared_ptr<const PublishedLayout> layout;
+
+    PublishedChunk(const std::byte *source, const size_t chunkBytes, const size_t rowsCount, const size_t alignment, std::shared_ptr<const PublishedLayout> layout)
+        : bytes(static_cast<std::byte *>(::operator new(chunkBytes, std::align_val_t{alignment}))), rowsCount(rowsCount), alignment(alignment), layout(std::move(layout))
+    {
+        std::memcpy(bytes, source, chunkBytes);
+        for (const auto &[offset, info] : this->layout->nonTrivialColumns)
+            info->copyConstructFunc(bytes + offset, source + offset, rowsCount);
+    }
+
+    PublishedChunk(const PublishedChunk &) = delete;
+    PublishedChunk &operator=(const PublishedChunk &) = delete;
+
+    ~PublishedChunk()
+    {
+        for (const auto &[offset, info] : layout->nonTrivialColumns)
+            info->destroy(bytes + offset, rowsCount);
+        ::operator delete(bytes, std::align_val_t{alignment});
+    }
+};
+
+struct PublishedTable
+{
+    std::shared_ptr<const PublishedLayout> layout;
+    std::vector<std::shared_ptr<const PublishedChunk>> chunks;
+};
+} // namespace
+
+// records structural changes on a single thread. they get played back in `World::flush`
+// get the calling thread's buffer with `World::commands`
+struct alignas(64) CommandBuffer
+{
+    CommandBuffer() = default;
+    CommandBuffer(const CommandBuffer &) = delete;
+    CommandBuffer(CommandBuffer &&) = default;
+    CommandBuffer &operator=(const CommandBuffer &) = delete;
+    CommandBuffer &operator=(CommandBuffer &&) = delete;
+
+    // destroys the components of commands that never got played back
+    ~CommandBuffer()
+    {
+        clear_();
+    }
+
+    template <typename... Ts>
+    void addEntity(Ts... components);
+
+    void removeEntity(const Entity &entity)
+    {
+        push_(CommandType::removeEntity, entity, nullptr, 0);
+    }
+
+    template <typename... Ts>
+    void addComponents(const Entity &entity, Ts... components);
+
+    template <typename... Ts>
+    void removeComponents(const Entity &entity);
+
+    // skipped when the parent is removed by then
+    void setParent(const Entity &entity, const Entity &parent);
+
+    void removeParent(const Entity &entity);
+
+    size_t getCommandsCount() const
+    {
+        return _commandsCount;
+    }
+
+  private:
+    friend World;
+
+    // packed commands, each followed by its payload
+    std::vector<std::byte, CacheAlignedAllocator<std::byte>> _arena;
+    size_t _commandsCount = 0;
+
+    // whether a payload holds non-trivial components, which can't be moved or dropped as bytes
+    bool _hasNonTrivial = false;
+
+    // appends a command and returns it. its payload starts right after it
+    Command *push_(const CommandType type, const Entity entity, const SpawnInfo *spawnInfo, const size_t payloadSize)
+    {
+        // keep every command header and payload aligned. headers start at `max_align_t` boundaries
+        const size_t offset = _arena.size();
+        const size_t payloadAlignment = spawnInfo ? std::max(spawnInfo->alignment, alignof(std::max_align_t)) : alignof(std::max_align_t);
+        const size_t payloadOffset = ((offset + sizeof(Command) + payloadAlignment - 1) & ~(payloadAlignment - 1)) - offset;
+        const size_t size = (payloadOffset + payloadSize + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+        if (_hasNonTrivial && offset + size > _arena.capacity())
+            grow_(offset + size);
+        _arena.resize(offset + size);
+        _commandsCount++;
+        _hasNonTrivial |= spawnInfo && !spawnInfo->trivial;
+        return new (_arena.data() + offset) Command{type, static_cast<uint8_t>(payloadOffset), static_cast<uint32_t>(size), entity, spawnInfo, nullptr, nullptr};
+    }
+
+    // reallocates the arena, moving the payloads properly
+    void grow_(const size_t minCapacity)
+    {
+        std::vector<std::byte, CacheAlignedAllocator<std::byte>> arena;
+        arena.reserve(std::max(minCapacity, _arena.capacity() * 2));
+        arena.resize(_arena.size());
+        for (size_t offset = 0; offset < _arena.size();)
+        {
+            Command &command = *reinterpret_cast<Command *>(_arena.data() + offset);
+            std::memcpy(arena.data() + offset, &command, command.spawnInfo ? sizeof(Command) : command.size);
+            if (command.spawnInfo)
+                command.spawnInfo->relocate(arena.data() + offset + command.payloadOffset, command.getPayload());
+            offset += command.size;
+        }
+        _arena = std::move(arena);
+    }
+
+    template <typename... Ts>
+    static void writePayload_(Command *command, Ts &...components)
+    {
+        constexpr auto offsets = getPackedOffsets_<Ts...>();
+        std::byte *payload = command->getPayload();
+        size_t i = 0;
+        (..., (new (payload + offsets[i++]) Ts(std::move(components))));
+    }
+
+    // the payloads are destroyed, played back ones were moved from
+    void clear_()
+    {
+        if (_hasNonTrivial)
+            for (size_t offset = 0; offset < _arena.size();)
+            {
+                Command &command = *reinterpret_cast<Command *>(_arena.data() + offset);
+                if (command.spawnInfo)
+                    command.spawnInfo->destroy(command.getPayload());
+                offset += command.size;
+            }
+        _arena.clear();
+        _commandsCount = 0;
+        _hasNonTrivial = false;
+    }
+};
+
+template <typename... Ts>
+struct Query;
+
+// load balance of the last parallel execution
+struct ParallelStats
+{
+    size_t tasksCount;
+    size_t threadsCount;
+
+    // times a thread ran out of its own tasks and took half of another's
+    size_t stealsCount;
+
+    // busy thread time over total thread time, 1 is a perfect balance
+    double utilization;
+};
+
+// memory and layout of one archetype. see `World::stats`
+struct ArchetypeStats
+{
+    // component type names, tags included, in the archetype's order
+    std::vector<std::string_view> components;
+    uint32_t depth;
+    size_t rowsCount;
+    size_t rowsPerChunk;
+    size_t chunksCount;
+
+    // bytes of the allocated chunks, and of the rows in use (entities and components)
+    size_t capacityBytes;
+    size_t usedBytes;
+
+    // capacity not used by rows: the free rows of partially filled or reserved chunks and the column padding
+    size_t wastedBytes;
+
+    size_t pendingRemovalsCount;
+
+    // since the archetype's creation
+    size_t createdCount;
+    size_t migratedInCount;
+    size_t migratedOutCount;
+};
+
+// world-wide totals, and every archetype when asked for
+struct WorldStats
+{
+    std::vector<ArchetypeStats> archetypes;
+    size_t entitiesCount;
+    size_t archetypesCount;
+
+    // archetypes without rows, left behind by migrations
+    size_t emptyArchetypesCount;
+
+    size_t capacityBytes;
+    size_t usedBytes;
+    size_t wastedBytes;
+    size_t pendingRemovalsCount;
+    size_t queriesCount;
+};
+
+// copies one component into `count` uninitialized rows of its column. trivially copyable ones are copied by doubling
+// memcpys, so large fills run at memory bandwidth
+template <typename T>
+static void fillComponents_(std::byte *destination, const std::byte *component, const size_t count)
+{
+    if constexpr (std::is_trivially_copyable_v<T>)
+    {
+        std::memcpy(destination, component, sizeof(T));
+        for (size_t filled = 1; filled < count; filled *= 2)
+            std::memcpy(destination + filled * componentStride_<T>, destination, std::min(filled, count - filled) * componentStride_<T>);
+    }
+    else
+        for (size_t i = 0; i < count; i++)
+            new (destination + i * componentStride_<T>) T(*std::launder(reinterpret_cast<const T *>(component)));
+}
+
+// a reusable entity configuration: the resolved archetype of its components and one packed row of their values, which
+// `World::instantiate` copies straight into the columns. see `World::createPrefab`. it stays valid as long as its
+// world exists and loads no snapshot
+struct Prefab
+{
+    Prefab(Prefab &&other) noexcept
+        : _world(other._world), _generation(other._generation), _archetype(other._archetype), _row(std::move(other._row)),
+          _columns(std::move(other._columns))
+    {
+        other._columns.clear();
+    }
+
+    Prefab(const Prefab &) = delete;
+    Prefab &operator=(const Prefab &) = delete;
+    Prefab &operator=(Prefab &&) = delete;
+
+    ~Prefab()
+    {
+        for (const Column &column : _columns)
+            column.info->destroy(_row.data() + column.offset, 1);
+    }
+
+  private:
+    friend World;
+
+    // a non-tag component of the row
+    struct Column
+    {
+        size_t index; // in the archetype
+        size_t offset;
+        const ComponentInfo *info;
+        void (*fill)(std::byte *destination, const std::byte *component, size_t count);
+    };
+
+    // the world and its archetypes generation the archetype belongs to
+    const World *_world = nullptr;
+    size_t _generation = 0;
+
+    Archetype *_archetype = nullptr;
+    std::vector<std::byte, CacheAlignedAllocator<std::byte>> _row;
+    std::vector<Column> _columns;
+
+    Prefab() = default;
+};
+
+// read-only copy of a world at one `World::publishSnapshot`, safe to read from any thread while the world keeps
+// running. chunks not written between two publishes are shared by their snapshots instead of copied
+struct WorldSnapshot
+{
+    // calls function on every entity having the components it takes as `const T &`, optionally preceded by
+    // `const Entity &`. like `World::execute`, rows removed but not yet flushed before the publish are visited
+    template <typename Func>
+    void execute(Func &&func) const
+    {
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        constexpr size_t offset = std::is_same_v<std::remove_cvref_t<typename traits::template arg<0>>, Entity> ? 1 : 0;
+        execute_<offset>(func, std::make_index_sequence<traits::argsCount - offset>{});
+    }
+
+    size_t getTotalEntityCount() const
+    {
+        return _entitiesCount;
+    }
+
+    // world tick of the publish
+    size_t getTick() const
+    {
+        return _tick;
+    }
+
+  private:
+    friend World;
+
+    std::vector<PublishedTable> _tables;
+    size_t _entitiesCount = 0;
+    size_t _tick = 0;
+
+    template <size_t Offset, typename Func, size_t... Indices>
+    void execute_(Func &func, std::index_sequence<Indices...>) const
+    {
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        static_assert((... && std::is_same_v<typename traits::template arg<Indices + Offset>, const std::remove_cvref_t<typename traits::template arg<Indices + Offset>> &>), "usage error: snapshots are read-only, take components as `const T &`");
+        for (const PublishedTable &table : _tables)
+        {
+            // byte offsets of the requested columns. tables missing one are skipped
+            const std::array<size_t, sizeof...(Indices)> hashes{getTypeHash_<std::remove_cvref_t<typename traits::template arg<Indices + Offset>>>()...};
+            std::array<size_t, sizeof...(Indices)> offsets;
+            bool matches = true;
+            for (size_t i = 0; i < hashes.size() && matches; i++)
+            {
+                const auto &it = table.layout->columnOffsets.find(hashes[i]);
+                matches = it != table.layout->columnOffsets.end();
+                offsets[i] = matches ? it->second : 0;
+            }
+            if (!matches)
+                continue;
+
+            for (const auto &chunk : table.chunks)
+            {
+                std::byte *columns[sizeof...(Indices) + 1]{(offsets[Indices] == PublishedLayout::tagOffset ? getTagStorage_() : chunk->bytes + offsets[Indices])...};
+                const Entity *entities = reinterpret_cast<const Entity *>(chunk->bytes);
+                for (size_t j = 0; j < chunk->rowsCount; j++)
+                    if constexpr (Offset == 1)
+                        func(entities[j], *getColumnRow_<std::remove_cvref_t<typename traits::template arg<Indices + 1>>>(columns[Indices], j)...);
+                    else
+                        func(*getColumnRow_<std::remove_cvref_t<typename traits::template arg<Indices>>>(columns[Indices], j)...);
+            }
+        }
+    }
+};
+
+struct World
+{
+    template <typename...>
+    friend struct Query;
+    friend CommandBuffer;
+    friend struct Schedule;
+
+    // adds an entity right away. the components are moved into their columns (or their sparse sets, see
+    // `addComponents`)
+    template <typename... Ts>
+    Entity addEntity(Ts... components)
+    {
+        if constexpr ((... || isSparseComponent<Ts>))
+        {
+            const Entity entity = std::apply([&](auto &&...tableComponents) { return addEntity(std::move(tableComponents)...); }, std::tuple_cat(takeTableComponent_(components)...));
+            (..., insertSparse_(entity, components));
+            return entity;
+        }
+        else
+        {
+            auto &archetype = getOrCreateArchetype_<Ts...>();
+
+            const Entity entity = createEntity_();
+            EntityRecord &record = _entityRecords[entity.index];
+            record.archetype = &archetype;
+            record.rowIndex = archetype.addRow(entity, _tick);
+            (..., new (archetype.getComponentPtr(archetype.findColumnById(getComponentId_<Ts>()), record.rowIndex)) Ts(std::move(components)));
+            return entity;
+        }
+    }
+
+    // adds `count` entities right away, copying their components from the spans (each `count` long)
+    // every column is reserved once and filled with one copy per chunk
+    template <typename... Ts>
+    EntityRange addEntities(const size_t count, const std::span<const Ts>... components)
+    {
+        static_assert(!(... || isSparseComponent<Ts>), "usage error: sparse components can't be spawned in batches, add them with `addComponents`");
+        auto [archetype, firstRow, range] = addRows_<Ts...>(count);
+        (..., archetype->writeColumn(archetype->findColumnById(getComponentId_<Ts>()), firstRow, components.data(), count));
+        return range;
+    }
+
+    // adds `count` entities right away. the generator gets called as `void(size_t i, Ts &...components)` on each
+    // entity's default-constructed components, in place inside the columns
+    template <typename... Ts, typename Func>
+        requires std::invocable<Func, size_t, Ts &...>
+    EntityRange addEntities(const size_t count, Func &&generator)
+    {
+        static_assert(!(... || isSparseComponent<Ts>), "usage error: sparse components can't be spawned in batches, add them with `addComponents`");
+        auto [archetype, firstRow, range] = addRows_<Ts...>(count);
+        const size_t columns[]{archetype->findColumnById(getComponentId_<Ts>())...};
+        for (size_t row = firstRow; row < firstRow + count;)
+        {
+            // one chunk's run at a time
+            const size_t runCount = std::min(archetype->rowsPerChunk - row % archetype->rowsPerChunk, firstRow + count - row);
+            std::byte *ptrs[sizeof...(Ts)];
+            for (size_t c = 0; c < sizeof...(Ts); c++)
+                ptrs[c] = archetype->getComponentPtr(columns[c], row);
+            for (size_t j = 0; j < runCount; j++)
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    generator(row - firstRow + j, *new (ptrs[Is] + j * componentStride_<Ts>) Ts()...);
+                }(std::index_sequence_for<Ts...>{});
+            row += runCount;
+        }
+        return range;
+    }
+
+    // captures the archetype of Ts and one row of their values, so `instantiate` can spawn copies of it without
+    // looking anything up
+    template <typename... Ts>
+    Prefab createPrefab(Ts... components)
+    {
+        static_assert(!(... || isSparseComponent<Ts>), "usage error: sparse components can't be in prefabs, add them with `addComponents`");
+        static_assert((... && (alignof(Ts) <= chunkAlignment)), "usage error: components aligned beyond a cache line can't be in prefabs");
+        constexpr auto offsets = getPackedOffsets_<Ts...>();
+        Prefab prefab;
+        prefab._world = this;
+        prefab._generation = _archetypesGeneration;
+        prefab._archetype = &getOrCreateArchetype_<Ts...>();
+        prefab._row.resize(offsets.back());
+        size_t i = 0;
+        (..., addPrefabColumn_(prefab, components, offsets[i++]));
+        return prefab;
+    }
+
+    // adds `count` copies of a prefab right away. every column gets filled from the prefab's row in one pass per
+    // chunk. the prefab must come from this world, since the last `loadSnapshot`
+    EntityRange instantiate(const Prefab &prefab, const size_t count)
+    {
+        return std::get<2>(instantiateRows_(prefab, count));
+    }
+
+    // adds `count` copies of a prefab right away, then calls the patch as `void(size_t i, T &...components)` on each
+    // copy's components (any of the prefab's, by reference), e.g. to give each its own position
+    template <typename Func>
+    EntityRange instantiate(const Prefab &prefab, const size_t count, Func &&patch)
+    {
+        auto [archetype, firstRow, range] = instantiateRows_(prefab, count);
+        patchRows_(*archetype, firstRow, count, patch, std::make_index_sequence<FunctionTraits<std::decay_t<Func>>::argsCount - 1>{});
+        return range;
+    }
+
+    // removes an entity and its descendants. they are no longer alive right away, but their table components can
+    // still be read until the next flush, which removes them (and their sparse components) and frees the handles.
+    // removing them again before that does nothing
+    void removeEntity(const Entity &entity)
+    {
+        if (entity.index < _entityRecords.size() && _entityRecords[entity.index].generation == entity.generation && _entityRecords[entity.index].removed)
+            return;
+        EntityRecord &record = getRecord_(entity);
+        while (record.firstChild != noEntityIndex)
+            removeEntity(Entity{record.firstChild, _entityRecords[record.firstChild].generation});
+        unlinkParent_(entity.index);
+        markForRemoval_(*record.archetype, record.rowIndex);
+        record.removed = true;
+        _removedEntityIndices.push_back(entity.index);
+    }
+
+    // returns whether this handle refers to an entity which is not removed
+    bool isAlive(const Entity &entity) const
+    {
+        return entity.index < _entityRecords.size() && _entityRecords[entity.index].generation == entity.generation && _entityRecords[entity.index].archetype && !_entityRecords[entity.index].removed;
+    }
+
+    // the calling thread's command buffer. use it for structural changes inside `executeParallel` and `Schedule` systems
+    CommandBuffer &commands()
+    {
+        return _commandBuffers[omp_get_thread_num()];
+    }
+
+    // executes tasks awaiting a flush
+    void flush()
+    {
+        while (_executingCount != 0)
+        {
+        }
+        playbackCommands_();
+        for (const uint32_t index : _removedEntityIndices)
+        {
+            for (auto &set : _sparseSets)
+                if (set)
+                    set->remove(index);
+            EntityRecord &record = _entityRecords[index];
+            record.archetype = nullptr;
+            record.removed = false;
+            record.generation++;
+            _freeEntityIndices.push_back(index);
+        }
+        _removedEntityIndices.clear();
+        for (Archetype *archetype : _dirtyArchetypes)
+            archetype->flushMarks(_entityRecords, _tick);
+        _dirtyArchetypes.clear();
+        reserveCommandBuffers_(omp_get_max_threads());
+        plotStats_();
+    }
+
+    // returns whether this entity contains this component type
+    template <typename T>
+    bool componentExists(const Entity &entity)
+    {
+        if constexpr (isSparseComponent<T>)
+        {
+            getRecord_(entity);
+            const SparseStorage *set = findSparseSet_(getComponentId_<T>());
+            return set && set->contains(entity.index);
+        }
+        else
+            return getRowRecord_(entity).archetype->componentMask.test(getComponentId_<T>());
+    }
+
+    // returns a component from this entity. counts as a change for `changed<T>` (sparse components have no changes)
+    // assumes component exists in this entity (no error checking)
+    template <typename T>
+    T &getComponent(const Entity &entity)
+    {
+        static_assert(!isTag_<T>, "usage error: tags have no data, use `componentExists`");
+        if constexpr (isSparseComponent<T>)
+        {
+            getRecord_(entity);
+            return getSparseSet_<T>().get(entity.index);
+        }
+        else
+        {
+            const EntityRecord &record = getRowRecord_(entity);
+            const size_t column = record.archetype->findColumnById(getComponentId_<T>());
+            record.archetype->markChanged(record.rowIndex / record.archetype->rowsPerChunk, column, _tick);
+            return *(T *)record.archetype->getComponentPtr(column, record.rowIndex);
+        }
+    }
+
+    // returns a component from this entity without counting as a change, e.g. a parent's during a parallel execution
+    // assumes component exists in this entity (no error checking)
+    template <typename T>
+    const T &readComponent(const Entity &entity)
+    {
+        static_assert(!isTag_<T>, "usage error: tags have no data, use `componentExists`");
+        if constexpr (isSparseComponent<T>)
+        {
+            getRecord_(entity);
+            return getSparseSet_<T>().get(entity.index);
+        }
+        else
+        {
+            const EntityRecord &record = getRowRecord_(entity);
+            const size_t column = record.archetype->findColumnById(getComponentId_<T>());
+            return *(const T *)record.archetype->getComponentPtr(column, record.rowIndex);
+        }
+    }
+
+    // makes `parent` the parent of the entity. the entity and its descendants move to the archetypes of their new
+    // depth right away (their old rows need a flush)
+    void setParent(const Entity &entity, const Entity &parent)
+    {
+        getRecord_(entity);
+        EntityRecord &parentRecord = getRecord_(parent);
+        for (uint32_t ancestor = parent.index; ancestor != noEntityIndex; ancestor = _entityRecords[ancestor].parent)
+            if (ancestor == entity.index)
+            {
+                std::cerr << "usage error: entity " << entity.index << " can't be a descendant of itself" << std::endl;
+                abort();
+            }
+
+        unlinkParent_(entity.index);
+        EntityRecord &record = _entityRecords[entity.index];
+        record.parent = parent.index;
+        record.nextSibling = parentRecord.firstChild;
+        if (parentRecord.firstChild != noEntityIndex)
+            _entityRecords[parentRecord.firstChild].previousSibling = entity.index;
+        parentRecord.firstChild = entity.index;
+        setDepth_(entity.index, parentRecord.archetype->depth + 1);
+    }
+
+    // makes the entity a root again. see `setParent`
+    void removeParent(const Entity &entity)
+    {
+        if (getRecord_(entity).parent == noEntityIndex)
+            return;
+        unlinkParent_(entity.index);
+        setDepth_(entity.index, 0);
+    }
+
+    // `nullEntity` for roots
+    Entity getParent(const Entity &entity)
+    {
+        const uint32_t parent = getRecord_(entity).parent;
+        return parent != noEntityIndex ? Entity{parent, _entityRecords[parent].generation} : nullEntity;
+    }
+
+    // creates a copy of the children
+    std::vector<Entity> getChildren(const Entity &entity)
+    {
+        std::vector<Entity> children;
+        for (uint32_t child = getRecord_(entity).firstChild; child != noEntityIndex; child = _entityRecords[child].nextSibling)
+            children.push_back(Entity{child, _entityRecords[child].generation});
+        return children;
+    }
+
+    // 0 for roots
+    size_t getDepth(const Entity &entity)
+    {
+        return getRowRecord_(entity).archetype->depth;
+    }
+
+    // adds components to the entity. needs a flush, except for sparse components which are set (or replaced) right away
+    // outside executions. during executions they are recorded in the calling thread's command buffer, since the set's
+    // values are being visited
+    template <typename... Ts>
+    void addComponents(const Entity &entity, Ts... components)
+    {
+        EntityRecord &record = getRecord_(entity);
+        if constexpr ((... || isSparseComponent<Ts>))
+        {
+            (..., insertSparse_(entity, components));
+            std::apply([&](auto &&...tableComponents) {
+                if constexpr (sizeof...(tableComponents) > 0)
+                    addComponents(entity, std::move(tableComponents)...);
+            },
+                       std::tuple_cat(takeTableComponent_(components)...));
+        }
+        else
+        {
+            const auto &edge = getAddEdge_<Ts...>(*record.archetype);
+            const size_t rowIndex = migrateEntity_(record, edge);
+            size_t i = 0;
+            (..., new (edge.target->getComponentPtr(edge.addedColumns[i++], rowIndex)) Ts(std::move(components)));
+        }
+    }
+
+    // removes components from the entity. needs a flush, except for sparse components which are removed right away
+    // outside executions (see `addComponents`)
+    template <typename... Ts>
+    void removeComponents(const Entity &entity)
+    {
+        EntityRecord &record = getRecord_(entity);
+        if constexpr ((... || isSparseComponent<Ts>))
+        {
+            (..., removeSparse_<Ts>(entity));
+            [&]<typename... Tables>(std::type_identity<std::tuple<Tables...>>) {
+                if constexpr (sizeof...(Tables) > 0)
+                    removeComponents<Tables...>(entity);
+            }(std::type_identity<TableComponents_<Ts...>>{});
+        }
+        else
+            migrateEntity_(record, getRemoveEdge_<Ts...>(*record.archetype));
     }
 
     // executes function on this world's entities in multiple threads
+    // pointer arguments are optional components. Filters (`without`/`anyOf`) skip whole archetypes and
+    // `changed`/`added` skip whole chunks
+    template <typename... Filters, typename Func>
+    void executeParallel(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        executeOn_<true, false, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // executes function on this world's entities
+    // pointer arguments are optional components. Filters (`without`/`anyOf`) skip whole archetypes and
+    // `changed`/`added` skip whole chunks
+    template <typename... Filters, typename Func>
+    void execute(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        executeOn_<false, false, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // executes function once per contiguous run of matching rows in multiple threads. see `executeChunks`
+    template <typename... Filters, typename Func>
+    void executeChunksParallel(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        static_assert(isSpanFunction_<Func>, "usage error: chunk functions only take spans");
+        executeOn_<true, false, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // executes function once per contiguous run of matching rows (a chunk, or part of one), for hand-vectorized
+    // kernels. it takes `std::span<T>` to write or `std::span<const T>` to read each component (by value), optionally
+    // preceded by the rows' `std::span<const Entity>`
+    template <typename... Filters, typename Func>
+    void executeChunks(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        static_assert(isSpanFunction_<Func>, "usage error: chunk functions only take spans");
+        executeOn_<false, false, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // executes function on this world's entities one hierarchy depth after the other, so every parent is visited
+    // before its children. takes any function `execute` or `executeChunks` take
+    template <typename... Filters, typename Func>
+    void executeByDepth(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        executeOn_<false, true, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // executes function on this world's entities in multiple threads, one parallel sweep per hierarchy depth. the
+    // parents' are all done before their children's start, so children can read them (`readComponent`)
+    template <typename... Filters, typename Func>
+    void executeByDepthParallel(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        executeOn_<true, true, Filters...>(nullptr, nullptr, std::forward<Func>(func));
+    }
+
+    // returns a persistent query over the entities matching the terms. a term is either a required component or
+    // `optional`, `without`, `anyOf`, `changed` or `added`. create it once and reuse it, executing it performs no
+    // allocations. it stays valid as long as this world exists. each handle tracks its own last run for change
+    // detection, so give every system its own handle
+    template <typename... Terms>
+    Query<Terms...> query()
+    {
+        return Query<Terms...>(*this, getQueryState_<Terms...>());
+    }
+
+    // writes every entity to a file, each archetype's chunks as raw bytes. needs a flushed world and trivially
+    // copyable components. returns false when the file can't be written
+    bool saveSnapshot(const std::filesystem::path &path) const
+    {
+        static_assert(sizeof(size_t) == sizeof(uint64_t), "snapshots store hashes and sizes as 64 bits");
+        const bool hasCommands = std::any_of(_commandBuffers.begin(), _commandBuffers.end(), [](const CommandBuffer &buffer) { return buffer.getCommandsCount() > 0; });
+        if (_executingCount != 0 || _dirtyArchetypes.size() > 0 || hasCommands)
+        {
+            std::cerr << "usage error: snapshots can only be saved from a flushed world outside of executions" << std::endl;
+            abort();
+        }
+        for (const auto &set : _sparseSets)
+            if (set && set->size() > 0)
+            {
+                std::cerr << "usage error: sparse components can't be saved" << std::endl;
+                abort();
+            }
+
+        // the non-empty archetypes, in file order
+        std::vector<const Archetype *> archetypes;
+        // by archetype hash
+        engine::flatHashMap<size_t, uint32_t> archetypeIndices;
+        for (const auto &archetype : _archetypes)
+        {
+            if (archetype.getRowsCount() == 0)
+                continue;
+            for (const ComponentInfo *info : archetype.columnInfos)
+                if (!info->trivial)
+                {
+                    std::cerr << "usage error: component " << info->hash << " is not trivially copyable and can't be saved" << std::endl;
+                    abort();
+                }
+            if (archetype.alignment > snapshotPageSize)
+            {
+                std::cerr << "usage error: components aligned beyond " << snapshotPageSize << " bytes can't be saved" << std::endl;
+                abort();
+            }
+            archetypeIndices[archetype.hash] = static_cast<uint32_t>(archetypes.size());
+            archetypes.push_back(&archetype);
+        }
+
+        // the chunks come after everything else
+        size_t offset = sizeof(SnapshotHeader) + _entityRecords.size() * sizeof(SnapshotRecord) + _freeEntityIndices.size() * sizeof(uint32_t);
+        for (const Archetype *archetype : archetypes)
+            offset += sizeof(SnapshotArchetype) + archetype->componentHashes.size() * 2 * sizeof(uint64_t);
+        std::vector<SnapshotArchetype> descriptors;
+        descriptors.reserve(archetypes.size());
+        for (const Archetype *archetype : archetypes)
+        {
+            offset = (offset + snapshotPageSize - 1) & ~(snapshotPageSize - 1);
+            const size_t stride = (archetype->chunkBytes + archetype->alignment - 1) & ~(archetype->alignment - 1);
+            descriptors.push_back({archetype->componentHashes.size(), archetype->getRowsCount(), archetype->rowsPerChunk, archetype->chunkBytes, stride, offset, archetype->depth, 0});
+            offset += archetype->getChunksCount() * stride;
+        }
+
+        // written next to the path and renamed over it, so a world loaded from that path keeps its mapping
+        std::filesystem::path temporaryPath = path;
+        temporaryPath += ".tmp";
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        size_t position = 0;
+        auto write = [&](const void *data, const size_t size) {
+            file.write(static_cast<const char *>(data), size);
+            position += size;
+        };
+        auto pad = [&](const size_t target) {
+            static const char s_zeros[snapshotPageSize]{};
+            while (position < target)
+                write(s_zeros, std::min(snapshotPageSize, target - position));
+        };
+
+        const SnapshotHeader header{snapshotMagic, snapshotVersion, static_cast<uint32_t>(archetypes.size()), _entityRecords.size(), _freeEntityIndices.size()};
+        write(&header, sizeof(header));
+        for (size_t i = 0; i < archetypes.size(); i++)
+        {
+            write(&descriptors[i], sizeof(SnapshotArchetype));
+            write(archetypes[i]->componentHashes.data(), archetypes[i]->componentHashes.size() * sizeof(uint64_t));
+            write(archetypes[i]->componentSizes.data(), archetypes[i]->componentSizes.size() * sizeof(uint64_t));
+        }
+        for (const EntityRecord &record : _entityRecords)
+        {
+            const SnapshotRecord snapshotRecord{record.archetype ? archetypeIndices.at(record.archetype->hash) : noEntityIndex, record.generation, record.rowIndex, record.parent, record.firstChild, record.nextSibling, record.previousSibling};
+            write(&snapshotRecord, sizeof(snapshotRecord));
+        }
+        write(_freeEntityIndices.data(), _freeEntityIndices.size() * sizeof(uint32_t));
+
+        // only the rows' bytes are copied, the unused rows and the padding are written as zeros so the files are
+        // deterministic and carry no stale memory
+        std::vector<std::byte> chunk;
+        for (size_t i = 0; i < archetypes.size(); i++)
+        {
+            const Archetype &archetype = *archetypes[i];
+            chunk.resize(archetype.chunkBytes);
+            for (size_t c = 0; c < archetype.getChunksCount(); c++)
+            {
+                const std::byte *source = archetype.getChunkBytes(c);
+                const size_t rowsCount = archetype.getChunkRowsCount(c);
+                std::fill(chunk.begin(), chunk.end(), std::byte{0});
+                std::memcpy(chunk.data(), source, rowsCount * sizeof(Entity));
+                for (size_t j = 0; j < archetype.columnInfos.size(); j++)
+                {
+                    const ComponentInfo &info = *archetype.columnInfos[j];
+                    const size_t offset = archetype.columnOffsets[j];
+                    if (info.valueSize == info.size)
+                        std::memcpy(chunk.data() + offset, source + offset, rowsCount * info.size);
+                    else
+                        for (size_t row = 0; row < rowsCount; row++)
+                            std::memcpy(chunk.data() + offset + row * info.size, source + offset + row * info.size, info.valueSize);
+                }
+                pad(descriptors[i].dataOffset + c * descriptors[i].chunkStride);
+                write(chunk.data(), chunk.size());
+            }
+        }
+        file.close();
+        std::error_code error;
+        if (!file.fail())
+            std::filesystem::rename(temporaryPath, path, error);
+        if (file.fail() || error)
+        {
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+        return true;
+    }
+
+    // replaces every entity with the ones of a `saveSnapshot` file. the file gets mapped and the archetypes use its
+    // chunks in place (copy-on-write), so only the entity records get copied. its component types must be registered
+    // (used before, or `registerComponents`) with the same layout. returns false when the file can't be read or isn't
+    // a compatible snapshot, leaving the world as it was
+    bool loadSnapshot(const std::filesystem::path &path)
+    {
+        if (_executingCount != 0)
+        {
+            std::cerr << "usage error: snapshots can't be loaded during executions" << std::endl;
+            abort();
+        }
+        std::unique_ptr<MappedFile> mapping = MappedFile::open(path);
+        if (!mapping)
+            return false;
+        std::byte *const data = mapping->data;
+        const size_t size = mapping->size;
+        size_t offset = 0;
+        // empty sections may have no destination
+        auto read = [&](void *destination, const size_t bytes) {
+            if (bytes == 0)
+                return true;
+            if (bytes > size - offset)
+                return false;
+            std::memcpy(destination, data + offset, bytes);
+            offset += bytes;
+            return true;
+        };
+
+        SnapshotHeader header;
+        if (!read(&header, sizeof(header)) || header.magic != snapshotMagic || header.version != snapshotVersion)
+            return false;
+
+        // everything gets checked first, so a bad file leaves the world untouched
+        struct LoadedArchetype
+        {
+            SnapshotArchetype descriptor;
+            std::vector<size_t> hashes;
+            std::vector<size_t> sizes;
+        };
+        std::vector<LoadedArchetype> loaded(header.archetypesCount);
+        engine::flatHashMap<size_t, size_t> loadedByHash;
+        for (LoadedArchetype &archetype : loaded)
+        {
+            SnapshotArchetype &descriptor = archetype.descriptor;
+            if (!read(&descriptor, sizeof(descriptor)) || descriptor.componentsCount > size / sizeof(uint64_t))
+                return false;
+            archetype.hashes.resize(descriptor.componentsCount);
+            archetype.sizes.resize(descriptor.componentsCount);
+            if (!read(archetype.hashes.data(), descriptor.componentsCount * sizeof(uint64_t)) || !read(archetype.sizes.data(), descriptor.componentsCount * sizeof(uint64_t)))
+                return false;
+            // unregistered components or hashes out of their sorted order can't be laid out
+            for (size_t i = 0; i < archetype.hashes.size(); i++)
+                if (!tryFindComponentInfo_(archetype.hashes[i]) || (i > 0 && archetype.hashes[i - 1] <= archetype.hashes[i]))
+                    return false;
+            // each archetype once, which also keeps two component sets of one hash from reaching the registry
+            if (!loadedByHash.insert({getArchetypeHash_(archetype.hashes, descriptor.depth), 0}).second)
+                return false;
+
+            // the layout this build would give the same components
+            const Archetype layout(archetype.hashes, archetype.sizes, descriptor.depth);
+            if (layout.rowsPerChunk != descriptor.rowsPerChunk || layout.chunkBytes != descriptor.chunkBytes || descriptor.chunkStride % layout.alignment != 0 || descriptor.chunkStride < layout.chunkBytes || descriptor.dataOffset % snapshotPageSize != 0)
+                return false;
+            for (size_t i = 0; i < layout.columnInfos.size(); i++)
+                if (!layout.columnInfos[i]->trivial || layout.columnInfos[i]->size != layout.columnSizes[i])
+                    return false;
+            const size_t chunksCount = (descriptor.rowsCount + descriptor.rowsPerChunk - 1) / descriptor.rowsPerChunk;
+            if (descriptor.dataOffset > size || chunksCount > (size - descriptor.dataOffset) / descriptor.chunkStride)
+                return false;
+        }
+        if (header.recordsCount > size / sizeof(SnapshotRecord) || header.recordsCount >= noEntityIndex || header.freeIndicesCount > size / sizeof(uint32_t) || header.recordsCount * sizeof(SnapshotRecord) + header.freeIndicesCount * sizeof(uint32_t) > size - offset)
+            return false;
+        std::vector<SnapshotRecord> records(header.recordsCount);
+        std::vector<uint32_t> freeIndices(header.freeIndicesCount);
+        read(records.data(), records.size() * sizeof(SnapshotRecord));
+        read(freeIndices.data(), freeIndices.size() * sizeof(uint32_t));
+        // live records link only to live records, free ones link to nothing and are each listed once as free
+        auto isLive = [&](const uint32_t index) { return index < records.size() && records[index].archetype != noEntityIndex; };
+        for (const SnapshotRecord &record : records)
+        {
+            const uint32_t links[]{record.parent, record.firstChild, record.nextSibling, record.previousSibling};
+            if (record.archetype == noEntityIndex)
+            {
+                if (std::any_of(std::begin(links), std::end(links), [](const uint32_t link) { return link != noEntityIndex; }))
+                    return false;
+            }
+            else if (record.archetype >= loaded.size() || record.rowIndex >= loaded[record.archetype].descriptor.rowsCount || std::any_of(std::begin(links), std::end(links), [&](const uint32_t link) { return link != noEntityIndex && !isLive(link); }))
+                return false;
+        }
+        std::vector<bool> listedFree(records.size());
+        for (const uint32_t index : freeIndices)
+        {
+            if (index >= records.size() || records[index].archetype != noEntityIndex || listedFree[index])
+                return false;
+            listedFree[index] = true;
+        }
+
+        // every row belongs to exactly one live record: the row's entity is the record's, and each archetype has as
+        // many live records as rows
+        std::vector<size_t> recordsCounts(loaded.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const SnapshotRecord &record = records[i];
+            if (record.archetype == noEntityIndex)
+                continue;
+            const SnapshotArchetype &descriptor = loaded[record.archetype].descriptor;
+            Entity entity;
+            std::memcpy(&entity, data + descriptor.dataOffset + record.rowIndex / descriptor.rowsPerChunk * descriptor.chunkStride + record.rowIndex % descriptor.rowsPerChunk * sizeof(Entity), sizeof(Entity));
+            if (entity.index != i || entity.generation != record.generation)
+                return false;
+            recordsCounts[record.archetype]++;
+        }
+        for (size_t i = 0; i < loaded.size(); i++)
+            if (recordsCounts[i] != loaded[i].descriptor.rowsCount)
+                return false;
+
+        // children are one level deeper than their parent, so parents can't form cycles, and each parent's children
+        // list holds exactly the records naming it as their parent, linked both ways, so it ends
+        std::vector<uint32_t> childrenCounts(records.size());
+        for (const SnapshotRecord &record : records)
+        {
+            if (record.archetype == noEntityIndex)
+                continue;
+            const uint32_t depth = loaded[record.archetype].descriptor.depth;
+            if (record.parent == noEntityIndex)
+            {
+                if (depth != 0 || record.nextSibling != noEntityIndex || record.previousSibling != noEntityIndex)
+                    return false;
+            }
+            else if (depth != loaded[records[record.parent].archetype].descriptor.depth + 1)
+                return false;
+            else
+                childrenCounts[record.parent]++;
+        }
+        for (uint32_t i = 0; i < records.size(); i++)
+        {
+            uint32_t previous = noEntityIndex;
+            uint32_t count = 0;
+            for (uint32_t child = records[i].firstChild; child != noEntityIndex; child = records[child].nextSibling)
+            {
+                if (count == childrenCounts[i] || records[child].parent != i || records[child].previousSibling != previous)
+                    return false;
+                previous = child;
+                count++;
+            }
+            if (count != childrenCounts[i])
+                return false;
+        }
+
+        // the previous contents, whose chunks may still be in the previous mapping
+        for (auto &buffer : _commandBuffers)
+            buffer.clear_();
+        _dirtyArchetypes.clear();
+        _removedEntityIndices.clear();
+        for (auto &query : _queries)
+            query.archetypes.clear();
+        _publishedTables.clear();
+        _archetypes.clear();
+        _archetypesByHash.clear();
+        _archetypesGeneration++;
+        for (auto &set : _sparseSets)
+            if (set)
+                set->clear();
+        _maxDepth = 0;
+        _snapshotMapping = std::move(mapping);
+
+        std::vector<Archetype *> archetypes;
+        archetypes.reserve(loaded.size());
+        for (const LoadedArchetype &archetype : loaded)
+        {
+            const SnapshotArchetype &descriptor = archetype.descriptor;
+            Archetype &target = getOrCreateArchetype_(archetype.hashes, archetype.sizes, descriptor.depth);
+            target.adoptChunks(data + descriptor.dataOffset, descriptor.chunkStride, descriptor.rowsCount, _tick);
+            archetypes.push_back(&target);
+        }
+
+        _entityRecords.resize(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const SnapshotRecord &record = records[i];
+            _entityRecords[i] = EntityRecord{record.archetype != noEntityIndex ? archetypes[record.archetype] : nullptr, record.rowIndex, record.generation, false, record.parent, record.firstChild, record.nextSibling, record.previousSibling};
+        }
+        _freeEntityIndices = std::move(freeIndices);
+        return true;
+    }
+
+    // publishes a read-only copy of this world for other threads (see `getPublishedSnapshot`). only the chunks
+    // written since the last publish get copied, the rest are shared with the previous snapshot. non-trivial
+    // components get copy-constructed (and must be copyable). call it outside of executions, usually once per frame
+    // after the flush
+    void publishSnapshot()
+    {
+        if (_executingCount != 0)
+        {
+            std::cerr << "usage error: snapshots can't be published during executions" << std::endl;
+            abort();
+        }
+        const size_t tick = _tick++;
+        auto snapshot = std::make_shared<WorldSnapshot>();
+        snapshot->_tick = tick;
+        snapshot->_tables.reserve(_archetypes.size());
+        for (auto &archetype : _archetypes)
+        {
+            if (archetype.getRowsCount() == 0)
+            {
+                _publishedTables.erase(archetype.hash);
+                continue;
+            }
+            PublishedTable &published = _publishedTables[archetype.hash];
+            if (!published.layout)
+                published.layout = createPublishedLayout_(archetype);
+            published.chunks.resize(archetype.getChunksCount());
+            for (size_t c = 0; c < published.chunks.size(); c++)
+            {
+                auto &chunk = published.chunks[c];
+                const size_t rowsCount = archetype.getChunkRowsCount(c);
+                if (!chunk || chunk->rowsCount != rowsCount || archetype.getWrittenTick(c) > _lastPublishTick)
+                    chunk = std::make_shared<const PublishedChunk>(archetype.getChunkBytes(c), archetype.chunkBytes, rowsCount, archetype.alignment, published.layout);
+            }
+            snapshot->_tables.push_back(published);
+            snapshot->_entitiesCount += archetype.getRowsCount();
+        }
+        _lastPublishTick = tick;
+
+        std::lock_guard lock(_publishedSnapshotMutex);
+        _publishedSnapshot = std::move(snapshot);
+    }
+
+    // the last published snapshot, null before the first. callable from any thread. it stays valid as long as it's
+    // held, also across later publishes
+    std::shared_ptr<const WorldSnapshot> getPublishedSnapshot() const
+    {
+        std::lock_guard lock(_publishedSnapshotMutex);
+        return _publishedSnapshot;
+    }
+
+    // registers component types up front, e.g. the ones of a snapshot about to be loaded
+    template <typename... Ts>
+    static void registerComponents()
+    {
+        (..., getComponentInfo_<Ts>());
+    }
+
+    // memory and layout of every archetype and their totals. `archetypes` stays empty without perArchetype
+    WorldStats stats(const bool perArchetype = true) const
+    {
+        WorldStats result{};
+        result.archetypesCount = _archetypes.size();
+        result.queriesCount = _queries.size();
+        if (perArchetype)
+            result.archetypes.reserve(_archetypes.size());
+        for (const auto &archetype : _archetypes)
+        {
+            size_t rowBytes = sizeof(Entity);
+            for (const size_t size : archetype.columnSizes)
+                rowBytes += size;
+            const size_t capacityBytes = archetype.getAllocatedChunksCount() * archetype.chunkBytes;
+            const size_t usedBytes = archetype.getRowsCount() * rowBytes;
+
+            result.entitiesCount += archetype.getRowsCount();
+            result.emptyArchetypesCount += archetype.getRowsCount() == 0;
+            result.capacityBytes += capacityBytes;
+            result.usedBytes += usedBytes;
+            result.wastedBytes += capacityBytes - usedBytes;
+            result.pendingRemovalsCount += archetype.getPendingRemovalsCount();
+            if (!perArchetype)
+                continue;
+
+            ArchetypeStats &stats = result.archetypes.emplace_back();
+            stats.components.reserve(archetype.componentHashes.size());
+            for (const size_t hash : archetype.componentHashes)
+                stats.components.push_back(findComponentInfo_(hash).name);
+            stats.depth = archetype.depth;
+            stats.rowsCount = archetype.getRowsCount();
+            stats.rowsPerChunk = archetype.rowsPerChunk;
+            stats.chunksCount = archetype.getAllocatedChunksCount();
+            stats.capacityBytes = capacityBytes;
+            stats.usedBytes = usedBytes;
+            stats.wastedBytes = capacityBytes - usedBytes;
+            stats.pendingRemovalsCount = archetype.getPendingRemovalsCount();
+            stats.createdCount = archetype.getCreatedCount();
+            stats.migratedInCount = archetype.getMigratedInCount();
+            stats.migratedOutCount = archetype.getMigratedOutCount();
+        }
+        return result;
+    }
+
+    size_t getTotalEntityCount() const
+    {
+        size_t r = 0;
+        for (auto &archetype : _archetypes)
+            r += archetype.getRowsCount();
+        return r;
+    }
+
+    size_t getTotalArchetypesCount() const
+    {
+        return _archetypes.size();
+    }
+
+    // rows per task of parallel executions. smaller balances uneven rows better, larger has less overhead
+    void setParallelGrainSize(const size_t rowsCount)
+    {
+        if (rowsCount == 0)
+        {
+            std::cerr << "usage error: parallel grain size can't be zero\n";
+            abort();
+        }
+        _parallelGrainSize = rowsCount;
+    }
+
+    size_t getParallelGrainSize() const
+    {
+        return _parallelGrainSize;
+    }
+
+    ParallelStats getParallelStats() const
+    {
+        std::lock_guard lock(_parallelStatsMutex);
+        return _parallelStats;
+    }
+
+  private:
+    // the loaded snapshot, whose chunks the archetypes use in place. declared first so it outlives them
+    std::unique_ptr<MappedFile> _snapshotMapping;
+
+    // in creation order. a deque so the records and queries can point to them
+    std::deque<Archetype> _archetypes;
+
+    // bumped when the archetypes get replaced, which leaves prefabs of earlier generations dangling
+    size_t _archetypesGeneration = 0;
+
+    // exact archetype hash to archetype map
+    engine::flatHashMap<size_t, Archetype *> _archetypesByHash;
+
+    // matched archetypes for a components' hash search
+    std::deque<QueryState> _queries;
+    engine::flatHashMap<size_t, QueryState *> _queriesByHash;
+
+    // entity index to its location
+    std::vector<EntityRecord> _entityRecords;
+
+    // sets of the sparse component types, indexed by component id. created on first use and kept, so query states
+    // can point to them
+    std::vector<std::unique_ptr<SparseStorage>> _sparseSets;
+
+    // removed entity indices ready for reuse
+    std::vector<uint32_t> _freeEntityIndices;
+
+    // removed since the last flush, which frees them
+    std::vector<uint32_t> _removedEntityIndices;
+
+    // archetypes with rows marked for removal since the last flush
+    std::vector<Archetype *> _dirtyArchetypes;
+
+    // one per thread, indexed by the OpenMP thread number. only resized outside executions, parallel executions use
+    // at most this many threads
+    std::vector<CommandBuffer> _commandBuffers = std::vector<CommandBuffer>(omp_get_max_threads());
+
+    // atomic since a `Schedule` runs executions concurrently
+    std::atomic<size_t> _executingCount = 0;
+
+    // change detection clock. every execution takes a tick, and writes outside executions use the next one
+    std::atomic<size_t> _tick = 1;
+
+    size_t _parallelGrainSize = 256;
+    // behind a mutex since a `Schedule` runs parallel executions concurrently
+    ParallelStats _parallelStats{};
+    mutable std::mutex _parallelStatsMutex;
+
+    // deepest hierarchy depth of any archetype
+    uint32_t _maxDepth = 0;
+
+    // chunks of the last publish per archetype hash, kept by the next one where they weren't written since
+    engine::flatHashMap<size_t, PublishedTable> _publishedTables;
+    size_t _lastPublishTick = 0;
+    std::shared_ptr<const WorldSnapshot> _publishedSnapshot;
+    mutable std::mutex _publishedSnapshotMutex;
+
+    // one command buffer per thread of a parallel region of threadsCount. executions index them concurrently, so this
+    // runs in `flush` and before a `Schedule` dispatches its systems
+    void reserveCommandBuffers_(const size_t threadsCount)
+    {
+        if (_executingCount != 0)
+        {
+            std::cerr << "usage error: command buffers can't be resized during executions\n";
+            abort();
+        }
+        if (_commandBuffers.size() < threadsCount)
+            _commandBuffers.resize(threadsCount);
+    }
+
+    // query is null when it should be derived from the function's arguments and the filters
+    // lastRunTick is null when the query state's should be used
+    // ByDepth visits the archetypes in hierarchy depth order
+    template <bool Parallel, bool ByDepth, typename... Filters, typename Func>
+    void executeOn_(QueryState *query, size_t *lastRunTick, Func &&func)
+    {
+        _executingCount++;
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        constexpr size_t argsCount = traits::argsCount;
+        using firstType = traits::template arg<0>;
+        if constexpr (isSpan_<std::remove_cvref_t<firstType>>)
+        {
+            constexpr size_t offset = std::is_same_v<std::remove_cvref_t<firstType>, std::span<const Entity>> ? 1 : 0;
+            executeChunks_<Parallel, ByDepth, offset, Filters...>(query, lastRunTick, std::forward<Func>(func), std::make_index_sequence<argsCount - offset>{});
+        }
+        else if constexpr (std::is_same_v<firstType, Entity &>)
+            executeWithEntity_<Parallel, ByDepth, Filters...>(query, lastRunTick, std::forward<Func>(func), std::make_index_sequence<argsCount - 1>{});
+        else
+            execute_<Parallel, ByDepth, Filters...>(query, lastRunTick, std::forward<Func>(func), std::make_index_sequence<argsCount>{});
+        _executingCount--;
+    }
+
+    template <bool Parallel, bool ByDepth, typename... Filters, typename Func, size_t... Indices>
+    void executeWithEntity_(QueryState *query, size_t *lastRunTick, Func &&func, std::index_sequence<Indices...>)
+    {
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        QueryState &state = query ? *query : getQueryState_<typename ArgTraits<typename traits::template arg<Indices + 1>>::term..., Filters...>();
+        size_t &lastRun = lastRunTick ? *lastRunTick : state.lastRunTick;
+        const size_t tick = _tick++;
+        // sets of the sparse components (null for table ones)
+        SparseStorage *const sparseSets[sizeof...(Indices)]{findSparseSet_<typename ArgTraits<typename traits::template arg<Indices + 1>>::component>()...};
+
+        auto executeRows = [&](Archetype &archetype, const size_t c, const size_t begin, const size_t end, const bool stamp) {
+            // column indices of the requested components (`noColumn` for missing optional ones)
+            const size_t columns[sizeof...(Indices)]{archetype.findColumnById(getComponentId_<typename ArgTraits<typename traits::template arg<Indices + 1>>::component>())...};
+            if (stamp)
+                (..., markIfWritten_<typename traits::template arg<Indices + 1>>(archetype, c, columns[Indices], tick));
+
+            // get internal component arrays of this chunk
+            void *ptrs[sizeof...(Indices)]{(columns[Indices] != Archetype::noColumn ? archetype.getChunkColumn(c, columns[Indices]) : nullptr)...};
+            const Entity *entities = archetype.getChunkEntities(c);
+            auto executeRow = [&](const size_t j) {
+                Entity entity = entities[j];
+                std::invoke(
+                    std::forward<Func>(func),
+                    entity,
+                    // take indices from internal component arrays
+                    getArg_<typename traits::template arg<Indices + 1>>(ptrs[Indices], j, sparseSets[Indices], entities[j])...);
+            };
+            if (state.hasSparseTerms())
+            {
+                for (size_t j = begin; j < end; j++)
+                    if (state.matchesSparse(entities[j].index))
+                        executeRow(j);
+            }
+            else
+                for (size_t j = begin; j < end; j++)
+                    executeRow(j);
+        };
+        if (ByDepth || !executeSparse_<Parallel>(state, lastRun, executeRows))
+            executeRanges_<Parallel, ByDepth>(state, lastRun, executeRows);
+        lastRun = tick;
+    }
+
+    template <bool Parallel, bool ByDepth, typename... Filters, typename Func, size_t... Indices>
+    void execute_(QueryState *query, size_t *lastRunTick, Func &&func, std::index_sequence<Indices...>)
+    {
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        QueryState &state = query ? *query : getQueryState_<typename ArgTraits<typename traits::template arg<Indices>>::term..., Filters...>();
+        size_t &lastRun = lastRunTick ? *lastRunTick : state.lastRunTick;
+        const size_t tick = _tick++;
+        // sets of the sparse components (null for table ones)
+        SparseStorage *const sparseSets[sizeof...(Indices)]{findSparseSet_<typename ArgTraits<typename traits::template arg<Indices>>::component>()...};
+
+        auto executeRows = [&](Archetype &archetype, const size_t c, const size_t begin, const size_t end, const bool stamp) {
+            // column indices of the requested components (`noColumn` for missing optional ones)
+            const size_t columns[sizeof...(Indices)]{archetype.findColumnById(getComponentId_<typename ArgTraits<typename traits::template arg<Indices>>::component>())...};
+            if (stamp)
+                (..., markIfWritten_<typename traits::template arg<Indices>>(archetype, c, columns[Indices], tick));
+
+            // get internal component arrays of this chunk
+            void *ptrs[sizeof...(Indices)]{(columns[Indices] != Archetype::noColumn ? archetype.getChunkColumn(c, columns[Indices]) : nullptr)...};
+            const Entity *entities = archetype.getChunkEntities(c);
+            auto executeRow = [&](const size_t j) {
+                std::invoke(
+                    std::forward<Func>(func),
+                    // take indices from internal component arrays
+                    getArg_<typename traits::template arg<Indices>>(ptrs[Indices], j, sparseSets[Indices], entities[j])...);
+            };
+            if (state.hasSparseTerms())
+            {
+                for (size_t j = begin; j < end; j++)
+                    if (state.matchesSparse(entities[j].index))
+                        executeRow(j);
+            }
+            else
+                for (size_t j = begin; j < end; j++)
+                    executeRow(j);
+        };
+        if (ByDepth || !executeSparse_<Parallel>(state, lastRun, executeRows))
+            executeRanges_<Parallel, ByDepth>(state, lastRun, executeRows);
+        lastRun = tick;
+    }
+
+    // Offset is 1 when the function takes the entities span first
+    template <bool Parallel, bool ByDepth, size_t Offset, typename... Filters, typename Func, size_t... Indices>
+    void executeChunks_(QueryState *query, size_t *lastRunTick, Func &&func, std::index_sequence<Indices...>)
+    {
+        using traits = FunctionTraits<std::decay_t<Func>>;
+        QueryState &state = query ? *query : getQueryState_<typename ArgTraits<std::remove_cvref_t<typename traits::template arg<Indices + Offset>>>::term..., Filters...>();
+        if (state.hasSparseTerms())
+        {
+            std::cerr << "usage error: chunk functions can't be executed on queries with sparse components" << std::endl;
+            abort();
+        }
+        size_t &lastRun = lastRunTick ? *lastRunTick : state.lastRunTick;
+        const size_t tick = _tick++;
+
+        auto executeRows = [&](Archetype &archetype, const size_t c, const size_t begin, const size_t end, const bool stamp) {
+            const size_t columns[sizeof...(Indices)]{archetype.findColumnById(getComponentId_<typename ArgTraits<std::remove_cvref_t<typename traits::template arg<Indices + Offset>>>::component>())...};
+            if (stamp)
+                (..., markIfWritten_<std::remove_cvref_t<typename traits::template arg<Indices + Offset>>>(archetype, c, columns[Indices], tick));
+            if constexpr (Offset == 1)
+                std::invoke(
+                    std::forward<Func>(func),
+                    std::span<const Entity>(archetype.getChunkEntities(c) + begin, end - begin),
+                    ArgTraits<std::remove_cvref_t<typename traits::template arg<Indices + 1>>>::get(archetype.getChunkColumn(c, columns[Indices]), begin, end)...);
+            else
+                std::invoke(
+                    std::forward<Func>(func),
+                    ArgTraits<std::remove_cvref_t<typename traits::template arg<Indices>>>::get(archetype.getChunkColumn(c, columns[Indices]), begin, end)...);
+        };
+        executeRanges_<Parallel, ByDepth>(state, lastRun, executeRows);
+        lastRun = tick;
+    }
+
+    // calls `executeRows(archetype, chunkIndex, begin, end, stamp)` over the matching chunks of the query's
+    // archetypes. chunk by chunk so each chunk's columns stay hot in cache. ByDepth makes one pass per hierarchy depth
+    // (a parallel region each), otherwise the archetypes are visited in a single pass. a chunk split into several
+    // tasks is stamped as written once, by its first one
+    template <bool Parallel, bool ByDepth, typename Func>
+    void executeRanges_(const QueryState &state, const size_t lastRun, Func &executeRows)
+    {
+        // archetypes created during the execution are not visited
+        const size_t archetypesCount = state.archetypes.size();
+        const uint32_t maxDepth = ByDepth ? _maxDepth : 0;
+
+        for (uint32_t depth = 0; depth <= maxDepth; depth++)
+        {
+            // nested parallel executions would reuse the calling thread's scratch, run them here instead
+            if constexpr (Parallel)
+                if (!omp_in_parallel())
+                {
+                    // one flat list across all archetypes, so small archetypes don't each pay for a parallel region
+                    std::vector<ParallelTask> &tasks = ParallelContext::get().tasks;
+                    tasks.clear();
+                    for (size_t i = 0; i < archetypesCount; i++)
+                    {
+                        Archetype &archetype = *state.archetypes[i];
+                        if (ByDepth && archetype.depth != depth)
+                            continue;
+                        for (size_t c = 0; c < archetype.getChunksCount(); c++)
+                        {
+                            // chunks not changed since the last run are skipped entirely
+                            if (state.signature.hasChunkTerms() && !state.signature.matchesChunk(archetype, c, lastRun))
+                                continue;
+                            const size_t rowsCount = archetype.getChunkRowsCount(c);
+                            for (size_t begin = 0; begin < rowsCount; begin += _parallelGrainSize)
+                                tasks.push_back({&archetype, c, begin, std::min(begin + _parallelGrainSize, rowsCount), begin == 0});
+                        }
+                    }
+                    if (!ByDepth || tasks.size() > 0)
+                        runParallelTasks_(tasks, executeRows);
+                    continue;
+                }
+
+            for (size_t i = 0; i < archetypesCount; i++)
+            {
+                Archetype &archetype = *state.archetypes[i];
+                if (ByDepth && archetype.depth != depth)
+                    continue;
+                for (size_t c = 0; c < archetype.getChunksCount(); c++)
+                {
+                    // chunks not changed since the last run are skipped entirely
+                    if (state.signature.hasChunkTerms() && !state.signature.matchesChunk(archetype, c, lastRun))
+                        continue;
+                    executeRows(archetype, c, 0, archetype.getChunkRowsCount(c), true);
+                }
+            }
+        }
+    }
+
+    // executions of queries requiring sparse components are driven by the smallest of their sets when it has fewer
+    // entities than the matching archetypes have rows: its entities are looked up in the tables one by one instead of
+    // every row being checked against the sets. returns false when the archetypes should be visited instead
+    template <bool Parallel, typename Func>
+    bool executeSparse_(const QueryState &state, const size_t lastRun, Func &executeRows)
+    {
+        const SparseStorage *smallest = nullptr;
+        for (const SparseStorage *set : state.sparseRequired)
+            if (!smallest || set->size() < smallest->size())
+                smallest = set;
+        if (!smallest)
+            return false;
+        size_t rowsCount = 0;
+        for (const Archetype *archetype : state.archetypes)
+            rowsCount += archetype->getRowsCount();
+        if (rowsCount <= smallest->size())
+            return false;
+
+        // parallel ones sort the matching rows by chunk and split each chunk's span of them into tasks, where the rows
+        // in between get checked against the sets like in the archetype visits
+        if constexpr (Parallel)
+            if (!omp_in_parallel())
+            {
+                std::vector<std::pair<Archetype *, size_t>> rows;
+                rows.reserve(smallest->size());
+                for (const Entity entity : smallest->entities)
+                {
+                    const EntityRecord &record = _entityRecords[entity.index];
+                    Archetype &archetype = *record.archetype;
+                    if (!state.signature.matches(archetype) || !state.matchesSparse(entity.index))
+                        continue;
+                    if (state.signature.hasChunkTerms() && !state.signature.matchesChunk(archetype, record.rowIndex / archetype.rowsPerChunk, lastRun))
+                        continue;
+                    rows.push_back({&archetype, record.rowIndex});
+                }
+                std::sort(rows.begin(), rows.end());
+
+                std::vector<ParallelTask> &tasks = ParallelContext::get().tasks;
+                tasks.clear();
+                for (size_t i = 0; i < rows.size();)
+                {
+                    Archetype *archetype = rows[i].first;
+                    const size_t c = rows[i].second / archetype->rowsPerChunk;
+                    bool stamp = true;
+                    while (i < rows.size() && rows[i].first == archetype && rows[i].second / archetype->rowsPerChunk == c)
+                    {
+                        const size_t begin = rows[i].second % archetype->rowsPerChunk;
+                        size_t end = begin + 1;
+                        for (i++; i < rows.size() && rows[i].first == archetype && rows[i].second / archetype->rowsPerChunk == c && rows[i].second % archetype->rowsPerChunk - begin < _parallelGrainSize; i++)
+                            end = rows[i].second % archetype->rowsPerChunk + 1;
+                        tasks.push_back({archetype, c, begin, end, stamp});
+                        stamp = false;
+                    }
+                }
+                runParallelTasks_(tasks, executeRows);
+                return true;
+            }
+
+        // entities added to the set during the execution are not visited
+        const size_t entitiesCount = smallest->size();
+        for (size_t i = 0; i < entitiesCount && i < smallest->size(); i++)
+        {
+            const Entity entity = smallest->entities[i];
+            const EntityRecord &record = _entityRecords[entity.index];
+            Archetype &archetype = *record.archetype;
+            if (!state.signature.matches(archetype) || !state.matchesSparse(entity.index))
+                continue;
+            const size_t c = record.rowIndex / archetype.rowsPerChunk;
+            if (state.signature.hasChunkTerms() && !state.signature.matchesChunk(archetype, c, lastRun))
+                continue;
+            const size_t row = record.rowIndex % archetype.rowsPerChunk;
+            executeRows(archetype, c, row, row + 1, true);
+        }
+        return true;
+    }
+
+    // runs the tasks in a single parallel region. every thread starts with a contiguous slice and when it runs out,
+    // steals the back half of another thread's remaining slice
     template <typename Func>
-    void executeParallel(Func &&func)
+    void runParallelTasks_(const std::vector<ParallelTask> &tasks, Func &executeRows)
+    {
+        if (tasks.size() > 0xffffffff)
+        {
+            std::cerr << "usage error: too many parallel tasks, increase the parallel grain size\n";
+            abort();
+        }
+        ParallelContext &context = ParallelContext::get();
+        const size_t threadsCount = std::max<size_t>(1, std::min<size_t>({static_cast<size_t>(omp_get_max_threads()), tasks.size(), _commandBuffers.size()}));
+        if (context.workersCount < threadsCount)
+        {
+            context.workers = std::make_unique<ParallelWorker[]>(threadsCount);
+            context.workersCount = threadsCount;
+        }
+        ParallelWorker *workers = context.workers.get();
+        for (size_t t = 0; t < threadsCount; t++)
+        {
+            workers[t].set(tasks.size() * t / threadsCount, tasks.size() * (t + 1) / threadsCount);
+            workers[t].stealsCount = 0;
+            workers[t].busyTime = 0;
+        }
+
+        const double start = omp_get_wtime();
+        // fewer threads than asked for is fine, the missing threads' slices get stolen
+#pragma omp parallel num_threads(static_cast<int>(threadsCount))
+        {
+            ParallelWorker &self = workers[omp_get_thread_num()];
+            const size_t selfIndex = omp_get_thread_num();
+            size_t task, begin, end;
+            while (true)
+            {
+                while (self.popFront(task))
+                    executeRows(*tasks[task].archetype, tasks[task].chunkIndex, tasks[task].begin, tasks[task].end, tasks[task].stamp);
+
+                // a full round without any work to steal means the execution is done
+                bool stole = false;
+                for (size_t k = 1; k < threadsCount && !stole; k++)
+                    if (workers[(selfIndex + k) % threadsCount].stealBack(begin, end))
+                    {
+                        self.set(begin, end);
+                        self.stealsCount++;
+                        stole = true;
+                    }
+                if (!stole)
+                    break;
+            }
+            self.busyTime = omp_get_wtime() - start;
+        }
+        const double elapsed = omp_get_wtime() - start;
+
+        ParallelStats stats{tasks.size(), threadsCount, 0, 0};
+        double busyTime = 0;
+        for (size_t t = 0; t < threadsCount; t++)
+        {
+            stats.stealsCount += workers[t].stealsCount;
+            busyTime += workers[t].busyTime;
+        }
+        stats.utilization = elapsed > 0 ? busyTime / (elapsed * threadsCount) : 1;
+        {
+            std::lock_guard lock(_parallelStatsMutex);
+            _parallelStats = stats;
+        }
+        TracyPlot("ecs parallel tasks", static_cast<int64_t>(stats.tasksCount));
+        TracyPlot("ecs parallel steals", static_cast<int64_t>(stats.stealsCount));
+        TracyPlot("ecs parallel utilization", stats.utilization);
+    }
+
+    // stamps a chunk's column as changed when the function argument is mutable
+    template <typename Arg>
+    static void markIfWritten_(Archetype &archetype, const size_t chunkIndex, const size_t columnIndex, const size_t tick)
+    {
+        if constexpr (ArgTraits<Arg>::writes)
+            if (columnIndex != Archetype::noColumn && columnIndex != Archetype::tagColumn)
+                archetype.markChanged(chunkIndex, columnIndex, tick);
+    }
+
+    void markForRemoval_(Archetype &archetype, const size_t rowIndex)
+    {
+        if (archetype.markForRemoval(rowIndex))
+            _dirtyArchetypes.push_back(&archetype);
+    }
+
+    SparseStorage *findSparseSet_(const uint32_t id) const
+    {
+        return id < _sparseSets.size() ? _sparseSets[id].get() : nullptr;
+    }
+
+    // null for table components
+    template <typename T>
+    SparseStorage *findSparseSet_() const
     {
-        _executingCount++;
-        using traits = FunctionTraits<std::decay_t<Func>>;
-        constexpr size_t argsCount = traits::argsCount;
-        using firstType = traits::template arg<0>;
-        if constexpr (std::is_same_v<firstType, Entity &>)
-            executeWithEntity_<true>(std::forward<Func>(func), std::make_index_sequence<argsCount - 1>{});
+        if constexpr (isSparseComponent<T>)
+            return findSparseSet_(getComponentId_<T>());
         else
-            execute_<true>(std::forward<Func>(func), std::make_index_sequence<argsCount>{});
-        _executingCount--;
+            return nullptr;
     }
 
-    // executes function on this world's entities
-    template <typename Func>
-    void execute(Func &&func)
+    template <typename T>
+    SparseSet<T> &getSparseSet_()
     {
-        _executingCount++;
-        using traits = FunctionTraits<std::decay_t<Func>>;
-        constexpr size_t argsCount = traits::argsCount;
-        using firstType = traits::template arg<0>;
-        if constexpr (std::is_same_v<firstType, Entity &>)
-            executeWithEntity_<false>(std::forward<Func>(func), std::make_index_sequence<argsCount - 1>{});
+        const uint32_t id = getComponentId_<T>();
+        if (id >= _sparseSets.size())
+            _sparseSets.resize(id + 1);
+        if (!_sparseSets[id])
+            _sparseSets[id] = std::make_unique<SparseSet<T>>();
+        return static_cast<SparseSet<T> &>(*_sparseSets[id]);
+    }
+
+    // creates the sparse set a query term refers to, so executions only look it up
+    template <typename T>
+    void createTermSparseSet_()
+    {
+        if constexpr (isSparseComponent<T>)
+            getSparseSet_<T>();
+    }
+
+    template <typename T>
+    void insertSparse_(const Entity entity, T &component)
+    {
+        if constexpr (isSparseComponent<T>)
+        {
+            if (_executingCount != 0)
+                commands().addComponents(entity, std::move(component));
+            else
+                getSparseSet_<T>().insert(entity, std::move(component));
+        }
+    }
+
+    template <typename T>
+    void removeSparse_(const Entity entity)
+    {
+        if constexpr (isSparseComponent<T>)
+        {
+            if (_executingCount != 0)
+                commands().removeComponents<T>(entity);
+            else if (SparseStorage *set = findSparseSet_(getComponentId_<T>()))
+                set->remove(entity.index);
+        }
+    }
+
+    // a table component as a one element tuple, a sparse one as an empty tuple. splits component packs with
+    // `std::tuple_cat`
+    template <typename T>
+    static auto takeTableComponent_(T &component)
+    {
+        if constexpr (isSparseComponent<T>)
+            return std::tuple<>();
         else
-            execute_<false>(std::forward<Func>(func), std::make_index_sequence<argsCount>{});
-        _executingCount--;
+            return std::tuple<T>(std::move(component));
     }
 
-    size_t getTotalEntityCount() const
+    // the table components of Ts
+    template <typename... Ts>
+    using TableComponents_ = decltype(std::tuple_cat(std::declval<std::conditional_t<isSparseComponent<Ts>, std::tuple<>, std::tuple<Ts>>>()...));
+
+    // aborts on handles of removed entities
+    EntityRecord &getRecord_(const Entity &entity)
     {
-        size_t r = 0;
-        for (auto &[_, archetype] : _archetypes)
-            r += archetype.getRowsCount();
-        return r;
+        if (!isAlive(entity))
+        {
+            std::cerr << "usage error: entity " << entity.index << " (generation " << entity.generation << ") is not alive" << std::endl;
+            abort();
+        }
+        return _entityRecords[entity.index];
     }
 
-    size_t getTotalArchetypesCount() const
+    // also the record of an entity removed since the last flush, whose row is still there
+    EntityRecord &getRowRecord_(const Entity &entity)
     {
-        return _archetypes.size();
+        if (entity.index >= _entityRecords.size() || _entityRecords[entity.index].generation != entity.generation || !_entityRecords[entity.index].archetype)
+        {
+            std::cerr << "usage error: entity " << entity.index << " (generation " << entity.generation << ") is not alive" << std::endl;
+            abort();
+        }
+        return _entityRecords[entity.index];
     }
 
-  private:
-    // exact archetype hash to archetype map
-    std::unordered_map<size_t, Archetype> _archetypes;
+    // allocates an entity index, reusing removed ones first. the record's location is left for the caller
+    Entity createEntity_()
+    {
+        if (_freeEntityIndices.size() > 0)
+        {
+            const uint32_t index = _freeEntityIndices.back();
+            _freeEntityIndices.pop_back();
+            return Entity{index, _entityRecords[index].generation};
+        }
+        _entityRecords.push_back(EntityRecord{nullptr, 0, 0});
+        return Entity{static_cast<uint32_t>(_entityRecords.size() - 1), 0};
+    }
+
+    // appends `count` rows with fresh contiguous entity indices to the archetype of Ts. the components are left
+    // uninitialized
+    template <typename... Ts>
+    std::tuple<Archetype *, size_t, EntityRange> addRows_(const size_t count)
+    {
+        return addRows_(getOrCreateArchetype_<Ts...>(), count);
+    }
+
+    std::tuple<Archetype *, size_t, EntityRange> addRows_(Archetype &archetype, const size_t count)
+    {
+        if (_entityRecords.size() + count > UINT32_MAX)
+        {
+            std::cerr << "usage error: too many entities: " << _entityRecords.size() + count << std::endl;
+            abort();
+        }
+        archetype.reserve(archetype.getRowsCount() + count);
+
+        const EntityRange range{static_cast<uint32_t>(_entityRecords.size()), static_cast<uint32_t>(count)};
+        const size_t firstRow = archetype.addRows(range, _tick);
+        _entityRecords.reserve(_entityRecords.size() + count);
+        for (size_t i = 0; i < count; i++)
+            _entityRecords.push_back(EntityRecord{&archetype, firstRow + i, 0});
+        return {&archetype, firstRow, range};
+    }
 
-    // cached archetypes for a components' hash search
-    std::unordered_map<size_t, std::vector<Archetype *>> _includeArchetypesCache;
+    // moves a prefab's component into its row and records its column. tags have neither
+    template <typename T>
+    static void addPrefabColumn_(Prefab &prefab, T &component, const size_t offset)
+    {
+        if constexpr (!isTag_<T>)
+        {
+            new (prefab._row.data() + offset) T(std::move(component));
+            prefab._columns.push_back({prefab._archetype->findColumnById(getComponentId_<T>()), offset, &getComponentInfo_<T>(), &fillComponents_<T>});
+        }
+    }
 
-    size_t _ver = 0;
-    size_t _executingCount = 0;
+    // chunk by chunk, every column of a chunk's run before the next, so the run stays in cache
+    std::tuple<Archetype *, size_t, EntityRange> instantiateRows_(const Prefab &prefab, const size_t count)
+    {
+        if (prefab._world != this || prefab._generation != _archetypesGeneration)
+        {
+            std::cerr << "usage error: prefabs can only be instantiated in their world, and not after it loaded a snapshot" << std::endl;
+            abort();
+        }
+        auto result = addRows_(*prefab._archetype, count);
+        Archetype &archetype = *std::get<0>(result);
+        const size_t firstRow = std::get<1>(result);
+        for (size_t row = firstRow; row < firstRow + count;)
+        {
+            const size_t runCount = std::min(archetype.rowsPerChunk - row % archetype.rowsPerChunk, firstRow + count - row);
+            for (const Prefab::Column &column : prefab._columns)
+                column.fill(archetype.getComponentPtr(column.index, row), prefab._row.data() + column.offset, runCount);
+            row += runCount;
+        }
+        return result;
+    }
 
-    template <bool Parallel, typename Func, size_t... Indices>
-    void executeWithEntity_(Func &&func, std::index_sequence<Indices...>)
+    // calls `patch(i, components...)` on fresh rows, one chunk's run at a time
+    template <typename Func, size_t... Indices>
+    static void patchRows_(Archetype &archetype, const size_t firstRow, const size_t count, Func &patch, std::index_sequence<Indices...>)
     {
         using traits = FunctionTraits<std::decay_t<Func>>;
-        using args = typename traits::args;
-        const auto [hashes, sizes] = createSortedHashesAndSizes_<std::decay_t<typename traits::template arg<Indices + 1>>...>();
-        std::vector<Archetype *> archetypes = findArchetypesWithHashes_(hashes);
-        void *ptrs[sizeof...(Indices)]; // for later use
-        for (size_t i = 0; i < archetypes.size(); i++)
+        const size_t columns[sizeof...(Indices)]{archetype.findColumnById(getComponentId_<typename ArgTraits<typename traits::template arg<Indices + 1>>::component>())...};
+        for (const size_t column : columns)
+            if (column == Archetype::noColumn)
+            {
+                std::cerr << "usage error: prefab patch uses components outside the prefab" << std::endl;
+                abort();
+            }
+        for (size_t row = firstRow; row < firstRow + count;)
         {
-            Archetype &archetype = *archetypes[i];
+            const size_t runCount = std::min(archetype.rowsPerChunk - row % archetype.rowsPerChunk, firstRow + count - row);
+            void *ptrs[sizeof...(Indices)]{archetype.getComponentPtr(columns[Indices], row)...};
+            for (size_t j = 0; j < runCount; j++)
+                std::invoke(patch, row - firstRow + j, ArgTraits<typename traits::template arg<Indices + 1>>::get(ptrs[Indices], j)...);
+            row += runCount;
+        }
+    }
+
+    // moves the entity along the edge (needs a flush for the old row). returns its new row
+    size_t migrateEntity_(EntityRecord &record, const Archetype::Edge &edge)
+    {
+        markForRemoval_(*record.archetype, record.rowIndex);
+        record.rowIndex = record.archetype->migrateRow(record.rowIndex, edge, _tick);
+        record.archetype = edge.target;
+        return record.rowIndex;
+    }
 
-            // get internal component arrays
-            ((ptrs[Indices] = (void *)archetype.getComponent(getTypeHash_<std::decay_t<typename traits::template arg<Indices + 1>>>(), 0).data()), ...);
+    template <typename... Ts>
+    static void playAddComponents_(World &world, const Entity &entity, std::byte *payload)
+    {
+        constexpr auto offsets = getPackedOffsets_<Ts...>();
+        if constexpr ((... || isSparseComponent<Ts>))
+            [&]<size_t... Is>(std::index_sequence<Is...>) {
+                world.addComponents(entity, std::move(*std::launder(reinterpret_cast<Ts *>(payload + offsets[Is])))...);
+            }(std::index_sequence_for<Ts...>{});
+        else
+        {
+            EntityRecord &record = world._entityRecords[entity.index];
+            const auto &edge = world.getAddEdge_<Ts...>(*record.archetype);
+            const size_t rowIndex = world.migrateEntity_(record, edge);
+            size_t i = 0;
+            (..., (new (edge.target->getComponentPtr(edge.addedColumns[i], rowIndex)) Ts(std::move(*std::launder(reinterpret_cast<Ts *>(payload + offsets[i])))), i++));
+        }
+    }
 
-            if constexpr (Parallel)
-#pragma omp parallel for schedule(static)
-                for (signed long long j = 0; j < archetype.getRowsCount(); j++)
+    template <typename... Ts>
+    static void playRemoveComponents_(World &world, const Entity &entity, std::byte *)
+    {
+        if constexpr ((... || isSparseComponent<Ts>))
+            world.removeComponents<Ts...>(entity);
+        else
+        {
+            EntityRecord &record = world._entityRecords[entity.index];
+            world.migrateEntity_(record, world.getRemoveEdge_<Ts...>(*record.archetype));
+        }
+    }
+
+    template <typename... Ts>
+    static const Archetype::Edge &resolveAddComponents_(World &world, Archetype &archetype)
+    {
+        return world.getAddEdge_<Ts...>(archetype);
+    }
+
+    template <typename... Ts>
+    static const Archetype::Edge &resolveRemoveComponents_(World &world, Archetype &archetype)
+    {
+        return world.getRemoveEdge_<Ts...>(archetype);
+    }
+
+    static void playSetParent_(World &world, const Entity &entity, std::byte *payload)
+    {
+        const Entity parent = *std::launder(reinterpret_cast<Entity *>(payload));
+        if (world.isAlive(parent))
+            world.setParent(entity, parent);
+    }
+
+    static void playRemoveParent_(World &world, const Entity &entity, std::byte *)
+    {
+        world.removeParent(entity);
+    }
+
+    // detaches an entity from its parent's children, leaving its depth for the caller
+    void unlinkParent_(const uint32_t index)
+    {
+        EntityRecord &record = _entityRecords[index];
+        if (record.parent == noEntityIndex)
+            return;
+        if (record.previousSibling != noEntityIndex)
+            _entityRecords[record.previousSibling].nextSibling = record.nextSibling;
+        else
+            _entityRecords[record.parent].firstChild = record.nextSibling;
+        if (record.nextSibling != noEntityIndex)
+            _entityRecords[record.nextSibling].previousSibling = record.previousSibling;
+        record.parent = record.nextSibling = record.previousSibling = noEntityIndex;
+    }
+
+    // moves an entity and its descendants to the archetypes of their depth (needs a flush for the old rows)
+    void setDepth_(const uint32_t index, const uint32_t depth)
+    {
+        EntityRecord &record = _entityRecords[index];
+        if (record.archetype->depth == depth)
+            return;
+        migrateEntity_(record, getDepthEdge_(*record.archetype, depth));
+        for (uint32_t child = record.firstChild; child != noEntityIndex; child = _entityRecords[child].nextSibling)
+            setDepth_(child, depth + 1);
+    }
+
+    // applies all the recorded commands, grouped by destination archetype so each one's rows are appended together.
+    // spawns go first. component additions and removals are grouped until a command needs an earlier one applied:
+    // a second one on the same entity, an entity removal or a parent change, which are applied in the order they got
+    // recorded (per thread). commands on removed entities are skipped
+    void playbackCommands_()
+    {
+        // groups of commands per destination archetype, found by its hash
+        std::vector<std::pair<Archetype *, std::vector<Command *>>> spawns;
+        engine::flatHashMap<size_t, size_t> spawnGroups;
+        for (auto &buffer : _commandBuffers)
+            for (size_t offset = 0; offset < buffer._arena.size();)
+            {
+                Command &command = *reinterpret_cast<Command *>(buffer._arena.data() + offset);
+                offset += command.size;
+                if (command.type != CommandType::addEntity)
+                    continue;
+                const auto [it, inserted] = spawnGroups.try_emplace(command.spawnInfo->hash, spawns.size());
+                if (inserted)
+                    spawns.push_back({&getOrCreateArchetype_(command.spawnInfo->hashes, command.spawnInfo->sizes), {}});
+                spawns[it->second].second.push_back(&command);
+            }
+
+        for (auto &[archetype, commands] : spawns)
+        {
+            const size_t firstRow = archetype->getRowsCount();
+            archetype->reserve(firstRow + commands.size());
+            for (size_t i = 0; i < commands.size(); i++)
+            {
+                const Entity entity = createEntity_();
+                EntityRecord &record = _entityRecords[entity.index];
+                record.archetype = archetype;
+                record.rowIndex = archetype->addRow(entity, _tick);
+            }
+
+            // per column (not per row). the spawn infos of one archetype share their sorted components, only the
+            // payload offsets differ. the moved-from payloads get destroyed when their buffer is cleared
+            for (size_t c = 0; c < archetype->componentHashes.size(); c++)
+            {
+                const size_t column = archetype->findColumn(archetype->componentHashes[c]);
+                if (column == Archetype::tagColumn)
+                    continue;
+                for (size_t i = 0; i < commands.size(); i++)
                 {
-                    Entity entity{static_cast<size_t>(j), archetype.hash, _ver};
-                    std::invoke(
-                        std::forward<Func>(func),
-                        entity,
-                        // take indices from internal component arrays
-                        ((std::decay_t<typename traits::template arg<Indices + 1>> *)ptrs[Indices])[j]...);
+                    const SpawnInfo &info = *commands[i]->spawnInfo;
+                    info.infos[c]->moveConstruct(archetype->getComponentPtr(column, firstRow + i), commands[i]->getPayload() + info.offsets[c], 1);
                 }
-            else
-                for (size_t j = 0; j < archetype.getRowsCount(); j++)
+            }
+        }
+
+        // the edges of queued commands are all resolved when they get applied, so edge pointers stay valid then
+        std::vector<std::pair<Archetype *, std::vector<Command *>>> migrations;
+        engine::flatHashMap<size_t, size_t> migrationGroups;
+        std::vector<bool> pending(_entityRecords.size());
+        size_t pendingCount = 0;
+        auto applyMigrations = [&] {
+            if (pendingCount == 0)
+                return;
+            std::vector<size_t> columns;
+            for (auto &[target, commands] : migrations)
+            {
+                target->reserve(target->getRowsCount() + commands.size());
+                const Archetype::Edge *edge = nullptr;
+                Archetype *edgeSource = nullptr;
+                const Archetype::Edge &(*edgeResolve)(World &, Archetype &) = nullptr;
+                for (Command *command : commands)
                 {
-                    Entity entity{j, archetype.hash, _ver};
-                    std::invoke(
-                        std::forward<Func>(func),
-                        entity,
-                        // take indices from internal component arrays
-                        ((std::decay_t<typename traits::template arg<Indices + 1>> *)ptrs[Indices])[j]...);
+                    EntityRecord &record = _entityRecords[command->entity.index];
+                    if (record.archetype != edgeSource || command->resolve != edgeResolve)
+                    {
+                        edgeSource = record.archetype;
+                        edgeResolve = command->resolve;
+                        edge = &edgeResolve(*this, *edgeSource);
+                        columns.clear();
+                        if (command->spawnInfo)
+                            for (const size_t hash : command->spawnInfo->hashes)
+                                columns.push_back(target->findColumn(hash));
+                    }
+                    const size_t rowIndex = migrateEntity_(record, *edge);
+                    pending[command->entity.index] = false;
+                    for (size_t c = 0; c < columns.size(); c++)
+                        if (columns[c] != Archetype::tagColumn)
+                            command->spawnInfo->infos[c]->moveConstruct(target->getComponentPtr(columns[c], rowIndex), command->getPayload() + command->spawnInfo->offsets[c], 1);
                 }
-        }
+                commands.clear();
+            }
+            pendingCount = 0;
+        };
+        size_t lastGroup = 0;
+        Archetype *lastSource = nullptr;
+        const Archetype::Edge &(*lastResolve)(World &, Archetype &) = nullptr;
+        for (auto &buffer : _commandBuffers)
+            for (size_t offset = 0; offset < buffer._arena.size();)
+            {
+                Command &command = *reinterpret_cast<Command *>(buffer._arena.data() + offset);
+                offset += command.size;
+                if (command.type == CommandType::addEntity || !isAlive(command.entity))
+                    continue;
+                if (command.type == CommandType::migrate && command.resolve)
+                {
+                    if (pending[command.entity.index])
+                        applyMigrations();
+                    Archetype *source = _entityRecords[command.entity.index].archetype;
+                    if (source != lastSource || command.resolve != lastResolve)
+                    {
+                        lastSource = source;
+                        lastResolve = command.resolve;
+                        Archetype *target = command.resolve(*this, *source).target;
+                        const auto [it, inserted] = migrationGroups.try_emplace(target->hash, migrations.size());
+                        if (inserted)
+                            migrations.push_back({target, {}});
+                        lastGroup = it->second;
+                    }
+                    migrations[lastGroup].second.push_back(&command);
+                    pending[command.entity.index] = true;
+                    pendingCount++;
+                    continue;
+                }
+                applyMigrations();
+                if (command.type == CommandType::removeEntity)
+                    removeEntity(command.entity);
+                else
+                    command.migrate(*this, command.entity, command.getPayload());
+            }
+        applyMigrations();
+        for (auto &buffer : _commandBuffers)
+            buffer.clear_();
     }
 
-    template <bool Parallel, typename Func, size_t... Indices>
-    void execute_(Func &&func, std::index_sequence<Indices...>)
+    // the archetypes map is this world's registry of component sets, so a combined hash shared by two different sets
+    // is caught here
+    Archetype &getOrCreateArchetype_(const std::vector<size_t> &hashes, const std::vector<size_t> &sizes, const uint32_t depth = 0)
     {
-        using traits = FunctionTraits<std::decay_t<Func>>;
-        using args = typename traits::args;
-        const auto [hashes, sizes] = createSortedHashesAndSizes_<std::decay_t<typename traits::template arg<Indices>>...>();
-        std::vector<Archetype *> archetypes = findArchetypesWithHashes_(hashes);
-        void *ptrs[sizeof...(Indices)]; // to be used later
-        for (size_t i = 0; i < archetypes.size(); i++)
+        const size_t hash = getArchetypeHash_(hashes, depth);
+        const auto &it = _archetypesByHash.find(hash);
+        if (it != _archetypesByHash.end())
         {
-            Archetype &archetype = *archetypes[i];
+            if (it->second->componentHashes != hashes || it->second->depth != depth)
+                abortHashCollision_(hash);
+            return *it->second;
+        }
 
-            // get internal component arrays
-            ((ptrs[Indices] = (void *)archetype.getComponent(getTypeHash_<std::decay_t<typename traits::template arg<Indices>>>(), 0).data()), ...);
+        // create new archetype
+        auto &archetype = _archetypes.emplace_back(hashes, sizes, depth);
+        _archetypesByHash.insert({hash, &archetype});
+        _maxDepth = std::max(_maxDepth, depth);
 
-            if constexpr (Parallel)
-#pragma omp parallel for schedule(static)
-                for (signed long long j = 0; j < archetype.getRowsCount(); j++)
-                    std::invoke(
-                        std::forward<Func>(func),
-                        // take indices from internal component arrays
-                        ((std::decay_t<typename traits::template arg<Indices>> *)ptrs[Indices])[j]...);
-            else
-                for (size_t j = 0; j < archetype.getRowsCount(); j++)
-                    std::invoke(
-                        std::forward<Func>(func),
-                        // take indices from internal component arrays
-                        ((std::decay_t<typename traits::template arg<Indices>> *)ptrs[Indices])[j]...);
-        }
+        // add to existing queries
+        for (auto &query : _queries)
+            if (query.signature.matches(archetype))
+                query.archetypes.push_back(&archetype);
+        return archetype;
     }
 
-    void abortIfEntityNotUpdated_(const Entity &entity) const
+    // root archetype of Ts. its hash is known at compile time, so a lookup costs no hashing, sorting or allocation
+    template <typename... Ts>
+    Archetype &getOrCreateArchetype_()
     {
-        if (entity.worldVer != _ver)
+        using signature = ComponentSignature<Ts...>;
+        const auto &it = _archetypesByHash.find(signature::hash);
+        if (it != _archetypesByHash.end())
         {
-            std::cerr << "usage error: version mismatch: " << entity.worldVer << " expected " << _ver << std::endl;
-            abort();
+            Archetype &archetype = *it->second;
+            // the root archetype has no hashes to compare, and comparing empty arrays passes null to memcmp
+            bool sameComponents = archetype.componentHashes.empty();
+            if constexpr (sizeof...(Ts) > 0)
+                sameComponents = std::equal(archetype.componentHashes.begin(), archetype.componentHashes.end(), signature::hashes.begin(), signature::hashes.end());
+            if (archetype.depth != 0 || !sameComponents)
+                abortHashCollision_(signature::hash);
+            return archetype;
         }
+        (..., getComponentInfo_<Ts>());
+        return getOrCreateArchetype_(std::vector<size_t>(signature::hashes.begin(), signature::hashes.end()), std::vector<size_t>(signature::sizes.begin(), signature::sizes.end()));
+    }
+
+    [[noreturn]] static void abortHashCollision_(const size_t hash)
+    {
+        std::cerr << "usage error: two different component sets have the same hash " << hash << ", rename a component" << std::endl;
+        abort();
     }
 
-    Archetype &getOrCreateArchetype_(const std::vector<size_t> &hashes, const std::vector<size_t> &sizes)
+    // returns the cached transition for adding Ts to this archetype, creating it on first use
+    template <typename... Ts>
+    const Archetype::Edge &getAddEdge_(Archetype &archetype)
     {
-        const size_t hash = getHash_(hashes);
-        const auto &it = _archetypes.find(hash);
-        if (it != _archetypes.end())
+        constexpr size_t key = getTypesKey_<Ts...>();
+        const auto &it = archetype.addEdges.find(key);
+        if (it != archetype.addEdges.end())
             return it->second;
 
-        // create new archetype
-        const auto &insertion = _archetypes.insert({hash, Archetype(hashes, sizes)});
-        auto &archetype = insertion.first->second;
+        // find target archetype
+        auto [hashes, sizes] = createAppendedSortedHashesAndSizes_<Ts...>(archetype.componentHashes, archetype.componentSizes);
+        auto &targetArchetype = getOrCreateArchetype_(hashes, sizes, archetype.depth);
+        return archetype.addEdges.insert({key, createEdge_(archetype, targetArchetype, {getTypeHash_<Ts>()...})}).first->second;
+    }
 
-        // add to hash caches
-        for (auto &[hash, archetypes] : _includeArchetypesCache)
-        {
-            const auto &componentHashes = _hashToSubHash.at(hash);
+    // returns the cached transition for removing Ts from this archetype, creating it on first use
+    template <typename... Ts>
+    const Archetype::Edge &getRemoveEdge_(Archetype &archetype)
+    {
+        constexpr size_t key = getTypesKey_<Ts...>();
+        const auto &it = archetype.removeEdges.find(key);
+        if (it != archetype.removeEdges.end())
+            return it->second;
+
+        // find target archetype
+        auto [hashes, sizes] = createRemovedSortedHashesAndSizes_<Ts...>(archetype.componentHashes, archetype.componentSizes);
+        auto &targetArchetype = getOrCreateArchetype_(hashes, sizes, archetype.depth);
+        return archetype.removeEdges.insert({key, createEdge_(archetype, targetArchetype, {})}).first->second;
+    }
+
+    // the totals of `stats`, once per flush (usually once per frame)
+    void plotStats_() const
+    {
+#ifdef TRACY_ENABLE
+        const WorldStats totals = stats(false);
+        TracyPlot("ecs entities", static_cast<int64_t>(totals.entitiesCount));
+        TracyPlot("ecs archetypes", static_cast<int64_t>(totals.archetypesCount));
+        TracyPlot("ecs empty archetypes", static_cast<int64_t>(totals.emptyArchetypesCount));
+        TracyPlot("ecs capacity bytes", static_cast<int64_t>(totals.capacityBytes));
+        TracyPlot("ecs wasted bytes", static_cast<int64_t>(totals.wastedBytes));
+#endif
+    }
 
-            // check if this archetype belongs to this set
-            if (hashCollides_(componentHashes, hashes))
-                archetypes.push_back(&archetype);
+    static std::shared_ptr<const PublishedLayout> createPublishedLayout_(const Archetype &archetype)
+    {
+        auto layout = std::make_shared<PublishedLayout>();
+        for (const auto &[hash, column] : archetype.componentHashMap)
+            layout->columnOffsets[hash] = column == Archetype::tagColumn ? PublishedLayout::tagOffset : archetype.columnOffsets[column];
+        for (size_t i = 0; i < archetype.columnInfos.size(); i++)
+        {
+            const ComponentInfo *info = archetype.columnInfos[i];
+            if (info->trivial)
+                continue;
+            if (!info->copyConstructFunc)
+            {
+                std::cerr << "usage error: component " << info->name << " can't be copied and can't be published" << std::endl;
+                abort();
+            }
+            layout->nonTrivialColumns.push_back({archetype.columnOffsets[i], info});
         }
-        return archetype;
+        return layout;
     }
 
-    std::vector<Archetype *> findArchetypesWithHashes_(const std::vector<size_t> hashes)
+    // returns the cached transition to this archetype's components at another depth, creating it on first use
+    const Archetype::Edge &getDepthEdge_(Archetype &archetype, const uint32_t depth)
     {
-        const size_t hash = getHash_(hashes);
-        const auto &it = _includeArchetypesCache.find(hash);
-        if (it != _includeArchetypesCache.end())
+        const auto &it = archetype.depthEdges.find(depth);
+        if (it != archetype.depthEdges.end())
             return it->second;
+        auto &targetArchetype = getOrCreateArchetype_(archetype.componentHashes, archetype.componentSizes, depth);
+        return archetype.depthEdges.insert({depth, createEdge_(archetype, targetArchetype, {})}).first->second;
+    }
+
+    static Archetype::Edge createEdge_(const Archetype &source, Archetype &target, const std::vector<size_t> &addedHashes)
+    {
+        Archetype::Edge edge{&target, {}, {}};
+        edge.columnMapping.reserve(source.columnHashes.size());
+        for (const size_t hash : source.columnHashes)
+        {
+            const auto &it = target.componentHashMap.find(hash);
+            edge.columnMapping.push_back(it != target.componentHashMap.end() ? it->second : Archetype::noColumn);
+        }
+        edge.addedColumns.reserve(addedHashes.size());
+        for (const size_t hash : addedHashes)
+            edge.addedColumns.push_back(target.componentHashMap.at(hash));
+        return edge;
+    }
+
+    // required components' hash, mixed with the filters' types when there are any
+    template <typename... Ts>
+    static constexpr size_t getQueryHash_()
+    {
+        // sorted and deduplicated like `createQuerySignature_`'s
+        std::array<size_t, sizeof...(Ts)> hashes{};
+        size_t count = 0;
+        (..., (QueryTerm<Ts>::isRequired ? void(hashes[count++] = QueryTerm<Ts>::requiredHash) : void()));
+        std::sort(hashes.begin(), hashes.begin() + count, std::greater<size_t>());
+        count = std::unique(hashes.begin(), hashes.begin() + count) - hashes.begin();
+
+        size_t hash = getHash_(std::span<const size_t>(hashes.data(), count));
+        if constexpr ((... || isFilterTerm_<Ts>))
+        {
+            hash ^= getTypesKey_<Ts...>();
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // returns the query state of a terms set, creating and matching it on first use
+    template <typename... Ts>
+    QueryState &getQueryState_()
+    {
+        constexpr size_t hash = getQueryHash_<Ts...>();
+        static const QuerySignature s_signature = createQuerySignature_<Ts...>();
+        const auto &it = _queriesByHash.find(hash);
+        if (it != _queriesByHash.end())
+        {
+            // the map is keyed by the hash alone, so a state of other terms with the same hash is caught here
+            if (!it->second->signature.hasSameRules(s_signature))
+                abortHashCollision_(hash);
+            return *it->second;
+        }
 
         // create
-        const auto &newIt = _includeArchetypesCache.insert({hash, {}}).first;
-        auto &archetypesList = newIt->second;
-        for (auto &[_, archetype] : _archetypes)
-            if (hashCollides_(hashes, archetype.componentHashes))
-                archetypesList.push_back(&archetype);
-        return archetypesList;
+        auto &query = _queries.emplace_back(QueryState{hash, s_signature, {}});
+        _queriesByHash.insert({hash, &query});
+        (..., createTermSparseSet_<typename QueryTerm<Ts>::component>());
+        for (const uint32_t id : query.signature.sparseRequiredIds)
+            query.sparseRequired.push_back(findSparseSet_(id));
+        for (const uint32_t id : query.signature.sparseExcludedIds)
+            query.sparseExcluded.push_back(findSparseSet_(id));
+        for (auto &archetype : _archetypes)
+            if (query.signature.matches(archetype))
+                query.archetypes.push_back(&archetype);
+        return query;
+    }
+};
+
+template <typename... Ts>
+void CommandBuffer::addEntity(Ts... components)
+{
+    static_assert(!(... || isSparseComponent<Ts>), "usage error: sparse components can't be recorded in spawns, add them with `addComponents`");
+    static_assert((... && (alignof(Ts) <= commandAlignment)), "usage error: components aligned beyond a cache line can't be recorded");
+    Command *command = push_(CommandType::addEntity, Entity{}, &getSpawnInfo_<Ts...>(), getPackedOffsets_<Ts...>().back());
+    writePayload_(command, components...);
+}
+
+template <typename... Ts>
+void CommandBuffer::addComponents(const Entity &entity, Ts... components)
+{
+    static_assert((... && (alignof(Ts) <= commandAlignment)), "usage error: components aligned beyond a cache line can't be recorded");
+    Command *command = push_(CommandType::migrate, entity, &getSpawnInfo_<Ts...>(), getPackedOffsets_<Ts...>().back());
+    command->migrate = &World::playAddComponents_<Ts...>;
+    if constexpr (!(... || isSparseComponent<Ts>))
+        command->resolve = &World::resolveAddComponents_<Ts...>;
+    writePayload_(command, components...);
+}
+
+template <typename... Ts>
+void CommandBuffer::removeComponents(const Entity &entity)
+{
+    Command *command = push_(CommandType::migrate, entity, nullptr, 0);
+    command->migrate = &World::playRemoveComponents_<Ts...>;
+    if constexpr (!(... || isSparseComponent<Ts>))
+        command->resolve = &World::resolveRemoveComponents_<Ts...>;
+}
+
+inline void CommandBuffer::setParent(const Entity &entity, const Entity &parent)
+{
+    Command *command = push_(CommandType::migrate, entity, nullptr, sizeof(Entity));
+    command->migrate = &World::playSetParent_;
+    new (command->getPayload()) Entity(parent);
+}
+
+inline void CommandBuffer::removeParent(const Entity &entity)
+{
+    Command *command = push_(CommandType::migrate, entity, nullptr, 0);
+    command->migrate = &World::playRemoveParent_;
+}
+
+// persistent handle to the archetypes matching a set of components. see `World::query`
+template <typename... Ts>
+struct Query
+{
+    // executes function on the matching entities in multiple threads. function arguments must be among Ts
+    template <typename Func>
+    void executeParallel(Func &&func)
+    {
+        static_assert(ArgsInComponents<typename FunctionTraits<std::decay_t<Func>>::args, Ts...>::value, "usage error: function uses components outside the query");
+        _world->executeOn_<true, false>(_state, &_lastRunTick, std::forward<Func>(func));
+    }
+
+    // executes function on the matching entities. function arguments must be among Ts
+    template <typename Func>
+    void execute(Func &&func)
+    {
+        static_assert(ArgsInComponents<typename FunctionTraits<std::decay_t<Func>>::args, Ts...>::value, "usage error: function uses components outside the query");
+        _world->executeOn_<false, false>(_state, &_lastRunTick, std::forward<Func>(func));
+    }
+
+    // executes function on the matching entities, parents before children. see `World::executeByDepth`
+    template <typename Func>
+    void executeByDepth(Func &&func)
+    {
+        static_assert(ArgsInComponents<typename FunctionTraits<std::decay_t<Func>>::args, Ts...>::value, "usage error: function uses components outside the query");
+        _world->executeOn_<false, true>(_state, &_lastRunTick, std::forward<Func>(func));
+    }
+
+    // executes function on the matching entities in multiple threads, one depth at a time. see
+    // `World::executeByDepthParallel`
+    template <typename Func>
+    void executeByDepthParallel(Func &&func)
+    {
+        static_assert(ArgsInComponents<typename FunctionTraits<std::decay_t<Func>>::args, Ts...>::value, "usage error: function uses components outside the query");
+        _world->executeOn_<true, true>(_state, &_lastRunTick, std::forward<Func>(func));
+    }
+
+    // executes function once per contiguous run of matching rows in multiple threads. see `World::executeChunks`
+    template <typename Func>
+    void executeChunksParallel(Func &&func)
+    {
+        static_assert(isSpanFunction_<Func>, "usage error: chunk functions only take spans");
+        executeParallel(std::forward<Func>(func));
+    }
+
+    // executes function once per contiguous run of matching rows. see `World::executeChunks`
+    template <typename Func>
+    void executeChunks(Func &&func)
+    {
+        static_assert(isSpanFunction_<Func>, "usage error: chunk functions only take spans");
+        execute(std::forward<Func>(func));
+    }
+
+    size_t getArchetypesCount() const
+    {
+        return _state->archetypes.size();
+    }
+
+  private:
+    friend World;
+
+    World *_world;
+    QueryState *_state;
+
+    // world tick of this handle's last execution
+    size_t _lastRunTick = 0;
+
+    Query(World &world, QueryState &state)
+        : _world(&world), _state(&state)
+    {
     }
 };
 } // namespace ecs
\ No newline at end of file
@@ -0,0 +1,278 @@
+#pragma once
+#include "ecs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <omp.h>
+#include <stdlib.h>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace ecs
+{
+namespace
+{
+// component hashes a system reads and writes
+struct SystemAccess
+{
+    std::vector<size_t> reads;
+    std::vector<size_t> writes;
+
+    // whether two systems can't run at the same time
+    bool conflicts(const SystemAccess &other) const
+    {
+        auto intersects = [](const std::vector<size_t> &a, const std::vector<size_t> &b) {
+            for (const size_t hash : a)
+                if (std::find(b.begin(), b.end(), hash) != b.end())
+                    return true;
+            return false;
+        };
+        return intersects(writes, other.writes) || intersects(writes, other.reads) || intersects(reads, other.writes);
+    }
+};
+
+// access of a function argument. `const T &` reads and `T &` writes, entities are never written during executions
+// and tags have no data to write
+template <typename Arg>
+static void addArgAccess_(SystemAccess &access)
+{
+    using component = typename ArgTraits<Arg>::component;
+    if constexpr (!std::is_same_v<component, Entity>)
+        (ArgTraits<Arg>::writes && !isTag_<component> ? access.writes : access.reads).push_back(getTypeHash_<component>());
+}
+
+// `changed`/`added` read the ticks that writers of T stamp. `without`/`anyOf` only match archetypes
+template <typename Filter>
+struct FilterAccess
+{
+    static void addTo(SystemAccess &)
+    {
+    }
+};
+
+template <typename T>
+struct FilterAccess<changed<T>>
+{
+    static void addTo(SystemAccess &access)
+    {
+        access.reads.push_back(getTypeHash_<T>());
+    }
+};
+
+template <typename T>
+struct FilterAccess<added<T>>
+{
+    static void addTo(SystemAccess &access)
+    {
+        access.reads.push_back(getTypeHash_<T>());
+    }
+};
+
+// access and persistent query of a system, from its arguments and its filters
+template <typename Args, typename... Filters>
+struct SystemInfo;
+
+template <typename... Args, typename... Filters>
+struct SystemInfo<std::tuple<Args...>, Filters...>
+{
+    static SystemAccess createAccess()
+    {
+        SystemAccess access;
+        (..., addArgAccess_<Args>(access));
+        (..., FilterAccess<Filters>::addTo(access));
+        return access;
+    }
+
+    static auto createQuery(World &world)
+    {
+        return world.query<typename ArgTraits<Args>::term..., Filters...>();
+    }
+};
+
+template <typename... Args, typename... Filters>
+struct SystemInfo<std::tuple<Entity &, Args...>, Filters...> : SystemInfo<std::tuple<Args...>, Filters...>
+{
+};
+
+template <typename... Args, typename... Filters>
+struct SystemInfo<std::tuple<std::span<const Entity>, Args...>, Filters...> : SystemInfo<std::tuple<Args...>, Filters...>
+{
+};
+} // namespace
+
+// runs a world's systems once per `run`, concurrently when their component accesses don't conflict.
+// two systems conflict when one writes a component the other reads or writes; conflicting systems run in
+// registration order. systems must record structural changes in `World::commands` and the world must be flushed
+// after `run`
+struct Schedule
+{
+    Schedule(World &world)
+        : _world(&world)
+    {
+    }
+
+    // registers a system and returns its index. its query is created here so running it performs no allocations.
+    // Filters are the same as `World::execute`'s
+    template <typename... Filters, typename Func>
+    size_t add(Func &&func)
+    {
+        static_assert((... && isFilterTerm_<Filters>), "usage error: only `without`, `anyOf`, `changed` and `added` can be given as filters");
+        using info = SystemInfo<typename FunctionTraits<std::decay_t<Func>>::args, Filters...>;
+        System &system = _systems.emplace_back();
+        system.run = [query = info::createQuery(*_world), func = std::forward<Func>(func)]() mutable {
+            query.execute(func);
+        };
+        system.access = info::createAccess();
+        _compiled = false;
+        return _systems.size() - 1;
+    }
+
+    // makes `system` always run after `dependency`, even when they don't conflict
+    void addDependency(const size_t system, const size_t dependency)
+    {
+        if (system >= _systems.size() || dependency >= _systems.size() || system == dependency)
+        {
+            std::cerr << "usage error: invalid system dependency " << dependency << " -> " << system << "\n";
+            abort();
+        }
+        _systems[system].dependencies.push_back(dependency);
+        _compiled = false;
+    }
+
+    // runs every system once. a worker takes the next ready system in registration order
+    void run()
+    {
+        if (!_compiled)
+            compile_();
+        const size_t systemsCount = _systems.size();
+        for (size_t i = 0; i < systemsCount; i++)
+        {
+            _pendingCounts[i].store(_systems[i].dependenciesCount, std::memory_order_relaxed);
+            _ready[i].store(noSystem, std::memory_order_relaxed);
+        }
+        _readyWriteIndex.store(0, std::memory_order_relaxed);
+        _readyReadIndex.store(0, std::memory_order_relaxed);
+        for (const size_t root : _roots)
+            pushReady_(root);
+
+        // systems without a path between them can all overlap, so up to one worker per system
+        const int threadsCount = static_cast<int>(std::max<size_t>(1, std::min<size_t>(omp_get_max_threads(), systemsCount)));
+        _world->reserveCommandBuffers_(omp_get_max_threads());
+#pragma omp parallel num_threads(threadsCount)
+        {
+            size_t slot;
+            while ((slot = _readyReadIndex.fetch_add(1, std::memory_order_relaxed)) < systemsCount)
+            {
+                // the slot gets filled once the system's dependencies are done
+                size_t system;
+                while ((system = _ready[slot].load(std::memory_order_acquire)) == noSystem)
+                    std::this_thread::yield();
+                _systems[system].run();
+                for (const size_t dependent : _systems[system].dependents)
+                    if (_pendingCounts[dependent].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        pushReady_(dependent);
+            }
+        }
+    }
+
+    size_t getSystemsCount() const
+    {
+        return _systems.size();
+    }
+
+  private:
+    static constexpr size_t noSystem = static_cast<size_t>(-1);
+
+    struct System
+    {
+        std::function<void()> run;
+        SystemAccess access;
+
+        // explicit ones from `addDependency`
+        std::vector<size_t> dependencies;
+
+        // derived in `compile_`
+        std::vector<size_t> dependents;
+        size_t dependenciesCount = 0;
+    };
+
+    World *_world;
+    std::vector<System> _systems;
+    bool _compiled = false;
+
+    // systems without dependencies
+    std::vector<size_t> _roots;
+
+    // per run state
+    std::unique_ptr<std::atomic<size_t>[]> _pendingCounts;
+    std::unique_ptr<std::atomic<size_t>[]> _ready;
+    std::atomic<size_t> _readyWriteIndex = 0;
+    std::atomic<size_t> _readyReadIndex = 0;
+
+    void pushReady_(const size_t system)
+    {
+        _ready[_readyWriteIndex.fetch_add(1, std::memory_order_relaxed)].store(system, std::memory_order_release);
+    }
+
+    // builds the dependency graph: conflicting systems in registration order, plus the explicit dependencies
+    void compile_()
+    {
+        const size_t systemsCount = _systems.size();
+        std::vector<std::vector<bool>> edges(systemsCount, std::vector<bool>(systemsCount));
+        for (size_t i = 0; i < systemsCount; i++)
+        {
+            for (size_t j = 0; j < i; j++)
+                if (_systems[i].access.conflicts(_systems[j].access))
+                    edges[j][i] = true;
+            for (const size_t dependency : _systems[i].dependencies)
+                edges[dependency][i] = true;
+        }
+
+        for (auto &system : _systems)
+        {
+            system.dependents.clear();
+            system.dependenciesCount = 0;
+        }
+        for (size_t i = 0; i < systemsCount; i++)
+            for (size_t j = 0; j < systemsCount; j++)
+                if (edges[i][j])
+                {
+                    _systems[i].dependents.push_back(j);
+                    _systems[j].dependenciesCount++;
+                }
+
+        // topological levels, to reject cycles
+        _roots.clear();
+        std::vector<size_t> pending(systemsCount), level;
+        for (size_t i = 0; i < systemsCount; i++)
+            if ((pending[i] = _systems[i].dependenciesCount) == 0)
+                level.push_back(i);
+        _roots = level;
+        size_t visitedCount = 0;
+        while (!level.empty())
+        {
+            visitedCount += level.size();
+            std::vector<size_t> next;
+            for (const size_t system : level)
+                for (const size_t dependent : _systems[system].dependents)
+                    if (--pending[dependent] == 0)
+                        next.push_back(dependent);
+            level = std::move(next);
+        }
+        if (visitedCount != systemsCount)
+        {
+            std::cerr << "usage error: system dependencies form a cycle\n";
+            abort();
+        }
+
+        _pendingCounts = std::make_unique<std::atomic<size_t>[]>(systemsCount);
+        _ready = std::make_unique<std::atomic<size_t>[]>(systemsCount);
+        _compiled = true;
+    }
+};
+} // namespace ecs
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstdlib>
 #include <tracy/Tracy.hpp>
+#include <typeinfo>
 
 namespace engine
 {
@@ -420,42 +420,7 @@ struct application
 
             preComponentHooksCopy.forEach([](const auto &func) { func(); });
 
-            {
-                bench("handling entities");
-                {
-                    bench("updating entities");
-                    entity::s_entities.forEachParallel([](const weakRef<entity> &entity) {
-                        entity->update_();
-                    });
-                }
-                {
-                    bench("adding/removing components");
-                    entity::s_entities.forEachParallel([](const weakRef<entity> &entity) {
-                        entity->removeComponents_();
-                        entity->addNewComponents_();
-                    });
-                }
-
-                {
-                    bench("removing entities");
-                    entity::s_entities.eraseIfUnordered([](const weakRef<entity> &entity) {
-                        if (entity->_removing)
-                        {
-                            entity->removed_();
-                            return true;
-                        }
-                        return false;
-                    });
-                }
-
-                {
-                    bench("adding new entities");
-                    entity::s_entities.reserve(entity::s_entities.size() + entity::s_newEntities.size());
-                    entity::s_newEntities.forEachAndClear([](const ownRef<entity> &entity) {
-                        entity::s_entities.emplace_back(std::move(entity));
-                    });
-                }
-            }
+            updateEntities();
             TracyPlot(s_tracyEntityCountName, static_cast<long long>(entity::getEntitiesCount()));
 
             {
@@ -489,6 +454,46 @@ struct application
         }
     }
 
+    // updates every entity's components, then applies the pending component and entity additions/removals. it's the
+    // part of a `run` frame between the pre and post component hooks
+    static inline void updateEntities()
+    {
+        bench("handling entities");
+        {
+            bench("updating entities");
+            entity::s_entities.forEachParallel([](const weakRef<entity> &entity) {
+                entity->update_();
+            });
+        }
+        {
+            bench("adding/removing components");
+            entity::s_entities.forEachParallel([](const weakRef<entity> &entity) {
+                entity->removeComponents_();
+                entity->addNewComponents_();
+            });
+        }
+
+        {
+            bench("removing entities");
+            entity::s_entities.eraseIfUnordered([](const weakRef<entity> &entity) {
+                if (entity->_removing)
+                {
+                    entity->removed_();
+                    return true;
+                }
+                return false;
+            });
+        }
+
+        {
+            bench("adding new entities");
+            entity::s_entities.reserve(entity::s_entities.size() + entity::s_newEntities.size());
+            entity::s_newEntities.forEachAndClear([](const ownRef<entity> &entity) {
+                entity::s_entities.emplace_back(std::move(entity));
+            });
+        }
+    }
+
     // thread-safe. exists the application after the current frame is finished
     static inline void close()
     {
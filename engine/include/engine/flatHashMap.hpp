@@ -0,0 +1,478 @@
+#pragma once
+
+#include "alloc.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define ENGINE_FLAT_HASH_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace engine
+{
+// open addressing hash map for keys that already are hashes (type hashes, combined component hashes), so they aren't
+// hashed again. the low bits of a key pick its first group of 16 slots and 7 more bits are kept in the slot's control
+// byte, a whole group of control bytes is matched at once (with SSE2 when available).
+// entries and control bytes live in one allocation. unlike std::unordered_map, inserting may move the entries, so
+// pointers and iterators to them are invalidated
+template <typename Key, typename Value, typename Alloc = alloc<std::byte>>
+struct flatHashMap
+{
+    static_assert(std::is_integral_v<Key>, "flatHashMap keys must be integral hashes");
+
+    using entry = std::pair<Key, Value>;
+    static_assert(alignof(entry) <= alignof(std::max_align_t), "flatHashMap entries can't be over aligned");
+
+    // slots matched together
+    static constexpr size_t groupWidth = 16;
+
+    template <bool Const>
+    struct iterator_
+    {
+        using map = std::conditional_t<Const, const flatHashMap, flatHashMap>;
+        using reference = std::conditional_t<Const, const entry &, entry &>;
+        using pointer = std::conditional_t<Const, const entry *, entry *>;
+
+        map *owner;
+        size_t slot;
+
+        reference operator*() const
+        {
+            return owner->_entries[slot];
+        }
+
+        pointer operator->() const
+        {
+            return &owner->_entries[slot];
+        }
+
+        // next full slot
+        iterator_ &operator++()
+        {
+            while (++slot < owner->_capacity && owner->_controls[slot] < 0)
+                ;
+            return *this;
+        }
+
+        bool operator==(const iterator_ &other) const
+        {
+            return slot == other.slot;
+        }
+
+        operator iterator_<true>() const
+            requires(!Const)
+        {
+            return {owner, slot};
+        }
+    };
+    using iterator = iterator_<false>;
+    using const_iterator = iterator_<true>;
+
+    flatHashMap() = default;
+
+    flatHashMap(const flatHashMap &other)
+    {
+        copyFrom_(other);
+    }
+
+    flatHashMap(flatHashMap &&other) noexcept
+        : _data(std::exchange(other._data, nullptr)),
+          _entries(std::exchange(other._entries, nullptr)),
+          _controls(std::exchange(other._controls, nullptr)),
+          _capacity(std::exchange(other._capacity, 0)),
+          _size(std::exchange(other._size, 0)),
+          _tombstonesCount(std::exchange(other._tombstonesCount, 0))
+    {
+    }
+
+    flatHashMap &operator=(const flatHashMap &other)
+    {
+        if (this != &other)
+        {
+            release_();
+            copyFrom_(other);
+        }
+        return *this;
+    }
+
+    flatHashMap &operator=(flatHashMap &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release_();
+            _data = std::exchange(other._data, nullptr);
+            _entries = std::exchange(other._entries, nullptr);
+            _controls = std::exchange(other._controls, nullptr);
+            _capacity = std::exchange(other._capacity, 0);
+            _size = std::exchange(other._size, 0);
+            _tombstonesCount = std::exchange(other._tombstonesCount, 0);
+        }
+        return *this;
+    }
+
+    ~flatHashMap()
+    {
+        release_();
+    }
+
+    size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    // slots, full or not
+    size_t capacity() const
+    {
+        return _capacity;
+    }
+
+    iterator begin()
+    {
+        return {this, firstFull_()};
+    }
+
+    iterator end()
+    {
+        return {this, _capacity};
+    }
+
+    const_iterator begin() const
+    {
+        return {this, firstFull_()};
+    }
+
+    const_iterator end() const
+    {
+        return {this, _capacity};
+    }
+
+    iterator find(const Key key)
+    {
+        return {this, findSlot_(key)};
+    }
+
+    const_iterator find(const Key key) const
+    {
+        return {this, findSlot_(key)};
+    }
+
+    bool contains(const Key key) const
+    {
+        return findSlot_(key) != _capacity;
+    }
+
+    size_t count(const Key key) const
+    {
+        return contains(key) ? 1 : 0;
+    }
+
+    Value &at(const Key key)
+    {
+        return _entries[checkedSlot_(key)].second;
+    }
+
+    const Value &at(const Key key) const
+    {
+        return _entries[checkedSlot_(key)].second;
+    }
+
+    Value &operator[](const Key key)
+    {
+        return try_emplace(key).first->second;
+    }
+
+    // constructs the value from args unless the key is already there
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key key, Args &&...args)
+    {
+        const size_t found = findSlot_(key);
+        if (found != _capacity)
+            return {{this, found}, false};
+
+        if (_size + _tombstonesCount + 1 > maxLoad_(_capacity))
+            grow_();
+        const size_t slot = findFreeSlot_(key);
+        if (_controls[slot] == deletedControl)
+            _tombstonesCount--;
+        new (&_entries[slot]) entry(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        _controls[slot] = getControl_(key);
+        _size++;
+        return {{this, slot}, true};
+    }
+
+    std::pair<iterator, bool> insert(const entry &value)
+    {
+        return try_emplace(value.first, value.second);
+    }
+
+    std::pair<iterator, bool> insert(entry &&value)
+    {
+        return try_emplace(value.first, std::move(value.second));
+    }
+
+    // leaves a tombstone, so the probe sequences through the slot stay intact
+    size_t erase(const Key key)
+    {
+        const size_t slot = findSlot_(key);
+        if (slot == _capacity)
+            return 0;
+        std::destroy_at(&_entries[slot]);
+        _controls[slot] = deletedControl;
+        _size--;
+        _tombstonesCount++;
+        return 1;
+    }
+
+    // keeps the allocation
+    void clear()
+    {
+        destroyEntries_();
+        if (_capacity > 0)
+            std::memset(_controls, static_cast<uint8_t>(emptyControl), _capacity);
+        _size = 0;
+        _tombstonesCount = 0;
+    }
+
+    // makes room for count entries without growing
+    void reserve(const size_t count)
+    {
+        if (count > maxLoad_(_capacity))
+            rehash_(getCapacityFor_(count));
+    }
+
+  private:
+    static constexpr int8_t emptyControl = -128;
+    static constexpr int8_t deletedControl = -2;
+
+    // control bytes of one group. full slots hold 7 bits of their key, free ones have the sign bit set
+    struct group_
+    {
+#ifdef ENGINE_FLAT_HASH_MAP_SSE2
+        __m128i controls;
+
+        explicit group_(const int8_t *groupControls)
+            : controls(_mm_loadu_si128(reinterpret_cast<const __m128i *>(groupControls)))
+        {
+        }
+
+        // bit per slot holding this control
+        uint32_t match(const int8_t control) const
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(controls, _mm_set1_epi8(control))));
+        }
+
+        // bit per empty or deleted slot
+        uint32_t matchFree() const
+        {
+            return static_cast<uint32_t>(_mm_movemask_epi8(controls));
+        }
+#else
+        const int8_t *controls;
+
+        explicit group_(const int8_t *groupControls)
+            : controls(groupControls)
+        {
+        }
+
+        uint32_t match(const int8_t control) const
+        {
+            uint32_t result = 0;
+            for (size_t i = 0; i < groupWidth; i++)
+                result |= static_cast<uint32_t>(controls[i] == control) << i;
+            return result;
+        }
+
+        uint32_t matchFree() const
+        {
+            uint32_t result = 0;
+            for (size_t i = 0; i < groupWidth; i++)
+                result |= static_cast<uint32_t>(controls[i] < 0) << i;
+            return result;
+        }
+#endif
+    };
+
+    std::byte *_data = nullptr;
+    entry *_entries = nullptr;
+    int8_t *_controls = nullptr;
+    size_t _capacity = 0;
+    size_t _size = 0;
+    size_t _tombstonesCount = 0;
+
+    // top 7 bits of the key folded by one multiplication. FNV hashes of names that differ in one character share
+    // their top bits, while a product's top bits depend on all of the key's bits
+    static int8_t getControl_(const Key key)
+    {
+        return static_cast<int8_t>((static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ULL) >> 57);
+    }
+
+    // full and deleted slots allowed before growing, 7/8 of the capacity
+    static size_t maxLoad_(const size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    static size_t getCapacityFor_(const size_t count)
+    {
+        size_t capacity = groupWidth;
+        while (maxLoad_(capacity) < count)
+            capacity *= 2;
+        return capacity;
+    }
+
+    static size_t getAllocationSize_(const size_t capacity)
+    {
+        return capacity * sizeof(entry) + capacity;
+    }
+
+    // groups are visited in triangular steps, which reach every group of a power of two count
+    template <typename Func>
+    size_t probe_(const Key key, Func &&func) const
+    {
+        const size_t groupsMask = _capacity / groupWidth - 1;
+        size_t groupIndex = static_cast<size_t>(key) & groupsMask;
+        for (size_t step = 1;; step++)
+        {
+            const size_t slot = func(groupIndex * groupWidth, group_(_controls + groupIndex * groupWidth));
+            if (slot != _capacity)
+                return slot;
+            groupIndex = (groupIndex + step) & groupsMask;
+        }
+    }
+
+    // the key's slot or the capacity when it's missing
+    size_t findSlot_(const Key key) const
+    {
+        if (_size == 0)
+            return _capacity;
+        const int8_t control = getControl_(key);
+        const size_t notFound = _capacity + 1;
+        const size_t slot = probe_(key, [&](const size_t first, const group_ &group) {
+            for (uint32_t matches = group.match(control); matches != 0; matches &= matches - 1)
+            {
+                const size_t candidate = first + std::countr_zero(matches);
+                if (_entries[candidate].first == key)
+                    return candidate;
+            }
+            // an empty slot ends every probe sequence the key could be on
+            return group.match(emptyControl) != 0 ? notFound : _capacity;
+        });
+        return slot == notFound ? _capacity : slot;
+    }
+
+    size_t checkedSlot_(const Key key) const
+    {
+        const size_t slot = findSlot_(key);
+        if (slot == _capacity)
+        {
+            std::cerr << "usage error: flatHashMap has no key " << key << std::endl;
+            abort();
+        }
+        return slot;
+    }
+
+    // first empty or deleted slot on the key's probe sequence
+    size_t findFreeSlot_(const Key key) const
+    {
+        return probe_(key, [&](const size_t first, const group_ &group) {
+            const uint32_t free = group.matchFree();
+            return free != 0 ? first + std::countr_zero(free) : _capacity;
+        });
+    }
+
+    size_t firstFull_() const
+    {
+        size_t slot = 0;
+        while (slot < _capacity && _controls[slot] < 0)
+            slot++;
+        return slot;
+    }
+
+    // drops the tombstones when they take most of the load, otherwise doubles
+    void grow_()
+    {
+        if (_capacity > 0 && _size + 1 <= maxLoad_(_capacity) / 2)
+            rehash_(_capacity);
+        else
+            rehash_(_capacity == 0 ? groupWidth : _capacity * 2);
+    }
+
+    void allocate_(const size_t capacity)
+    {
+        _data = Alloc::allocate(getAllocationSize_(capacity));
+        _entries = reinterpret_cast<entry *>(_data);
+        _controls = reinterpret_cast<int8_t *>(_data + capacity * sizeof(entry));
+        _capacity = capacity;
+        std::memset(_controls, static_cast<uint8_t>(emptyControl), capacity);
+    }
+
+    void rehash_(const size_t capacity)
+    {
+        std::byte *oldData = _data;
+        entry *oldEntries = _entries;
+        const int8_t *oldControls = _controls;
+        const size_t oldCapacity = _capacity;
+
+        allocate_(capacity);
+        for (size_t i = 0; i < oldCapacity; i++)
+            if (oldControls[i] >= 0)
+            {
+                const size_t slot = findFreeSlot_(oldEntries[i].first);
+                new (&_entries[slot]) entry(std::move(oldEntries[i]));
+                _controls[slot] = oldControls[i];
+                std::destroy_at(&oldEntries[i]);
+            }
+        _tombstonesCount = 0;
+        Alloc::deallocate(oldData, getAllocationSize_(oldCapacity));
+    }
+
+    void copyFrom_(const flatHashMap &other)
+    {
+        if (other._capacity == 0)
+            return;
+        allocate_(other._capacity);
+        for (size_t i = 0; i < _capacity; i++)
+            if (other._controls[i] >= 0)
+                new (&_entries[i]) entry(other._entries[i]);
+        std::memcpy(_controls, other._controls, _capacity);
+        _size = other._size;
+        _tombstonesCount = other._tombstonesCount;
+    }
+
+    void destroyEntries_()
+    {
+        if constexpr (!std::is_trivially_destructible_v<entry>)
+            for (size_t i = 0; i < _capacity; i++)
+                if (_controls[i] >= 0)
+                    std::destroy_at(&_entries[i]);
+    }
+
+    void release_()
+    {
+        if (_data == nullptr)
+            return;
+        destroyEntries_();
+        Alloc::deallocate(_data, getAllocationSize_(_capacity));
+        _data = nullptr;
+        _entries = nullptr;
+        _controls = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _tombstonesCount = 0;
+    }
+};
+} // namespace engine
@@ -0,0 +1,165 @@
+// checks of the ecs command buffers playback. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    int value;
+};
+
+// not trivially copyable, long enough to live on the heap
+struct Name
+{
+    std::string value;
+};
+
+struct Velocity
+{
+    double value;
+};
+
+struct Frozen
+{
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// spawns of different archetypes recorded interleaved land in their own archetypes, in recording order
+void playedInterleavedSpawns()
+{
+    ecs::World world;
+    auto &commands = world.commands();
+    for (int i = 0; i < 500; i++)
+    {
+        commands.addEntity(Position{i});
+        commands.addEntity(Position{-i - 1}, Name{std::string(40, 'n') + std::to_string(i)});
+        commands.addEntity(Name{std::string(40, 'm')}, Position{i});
+    }
+    check(world.getTotalEntityCount() == 0, "spawns wait for the flush");
+    world.flush();
+
+    check(world.getTotalEntityCount() == 1500, "every spawn is played");
+    std::vector<int> alone;
+    world.execute<ecs::without<Name>>([&](const Position &position) { alone.push_back(position.value); });
+    bool ordered = alone.size() == 500;
+    for (size_t i = 0; ordered && i < alone.size(); i++)
+        ordered = alone[i] == static_cast<int>(i);
+    check(ordered, "spawns of one archetype keep their recording order");
+
+    size_t named = 0;
+    bool namesKept = true;
+    world.execute([&](const Position &position, const Name &name) {
+        named++;
+        if (position.value < 0)
+            namesKept &= name.value == std::string(40, 'n') + std::to_string(-position.value - 1);
+        else
+            namesKept &= name.value == std::string(40, 'm');
+    });
+    check(named == 1000, "spawns with the same components in another order share an archetype");
+    check(namesKept, "spawned non-trivial components are moved intact");
+}
+
+// migrations of many entities to several archetypes, recorded interleaved, end up where the last command of each
+// entity says
+void playedInterleavedMigrations()
+{
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 1000; i++)
+        entities.push_back(world.addEntity(Position{i}));
+
+    auto &commands = world.commands();
+    for (int i = 0; i < 1000; i++)
+    {
+        const ecs::Entity entity = entities[i];
+        if (i % 4 == 0)
+            commands.addComponents(entity, Name{std::string(40, 'b') + std::to_string(i)});
+        else if (i % 4 == 1)
+        {
+            commands.addComponents(entity, Velocity{1}, Frozen{});
+            commands.removeComponents<Position>(entity);
+        }
+        else if (i % 4 == 2)
+        {
+            commands.addComponents(entity, Name{std::string(40, 'q')});
+            commands.removeEntity(entity);
+        }
+        else
+        {
+            commands.addComponents(entity, Velocity{3});
+            commands.addComponents(entity, Name{"first"});
+            commands.removeComponents<Name>(entity);
+            commands.addComponents(entity, Name{"last"});
+            commands.setParent(entity, entities[0]);
+        }
+    }
+    world.flush();
+
+    size_t named = 0;
+    bool namedRight = true;
+    world.execute<ecs::without<Velocity>>([&](const Position &position, const Name &name) {
+        named++;
+        namedRight &= position.value % 4 == 0 && name.value == std::string(40, 'b') + std::to_string(position.value);
+    });
+    check(named == 250, "entities given a component moved together");
+    check(namedRight, "moved entities keep their components and get the added ones");
+
+    size_t frozen = 0;
+    world.execute<ecs::without<Position>>([&](const Velocity &velocity, const Frozen &) {
+        frozen++;
+        check(velocity.value == 1, "components added along a removal are kept");
+    });
+    check(frozen == 250, "entities given and stripped of components in one flush moved once");
+
+    size_t children = 0;
+    world.execute([&](ecs::Entity &entity, const Position &position, const Name &name, const Velocity &velocity) {
+        children++;
+        check(position.value % 4 == 3 && velocity.value == 3, "chained additions keep every component");
+        check(name.value == "last", "chained commands of an entity apply in recording order");
+        check(world.getParent(entity) == entities[0], "parents set after migrations apply");
+    });
+    check(children == 250, "entities with chained commands moved");
+
+    size_t alive = 0;
+    for (int i = 0; i < 1000; i++)
+        alive += world.isAlive(entities[i]);
+    check(alive == 750 && world.getTotalEntityCount() == 750, "removals recorded after additions win");
+}
+
+// commands recorded on an entity removed earlier in the same playback are skipped
+void skippedRemovedTargets()
+{
+    ecs::World world;
+    const ecs::Entity entity = world.addEntity(Position{1});
+    auto &commands = world.commands();
+    commands.removeEntity(entity);
+    commands.addComponents(entity, Name{"late"});
+    commands.removeComponents<Position>(entity);
+    world.flush();
+    check(!world.isAlive(entity), "removed entity stays removed");
+    check(world.getTotalEntityCount() == 0, "commands on a removed entity spawn nothing");
+}
+} // namespace
+
+int main()
+{
+    playedInterleavedSpawns();
+    playedInterleavedMigrations();
+    skippedRemovedTargets();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsCommandsTests passed\n");
+}
@@ -0,0 +1,138 @@
+// checks of the ecs entity hierarchy. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <omp.h>
+#include <vector>
+
+namespace
+{
+struct Transform
+{
+    int local;
+    int world;
+};
+
+struct Marker
+{
+    int value;
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// parents, children and depths follow every link change, moving whole subtrees
+void linkedHierarchy()
+{
+    ecs::World world;
+    const ecs::Entity root = world.addEntity(Transform{1, 0});
+    const ecs::Entity child = world.addEntity(Transform{2, 0});
+    const ecs::Entity grandChild = world.addEntity(Transform{3, 0}, Marker{7});
+    const ecs::Entity sibling = world.addEntity(Transform{4, 0});
+    world.setParent(grandChild, child);
+    world.setParent(child, root);
+    world.setParent(sibling, root);
+    world.flush();
+
+    check(world.getParent(root) == ecs::nullEntity && world.getDepth(root) == 0, "roots have no parent");
+    check(world.getParent(child) == root && world.getDepth(child) == 1, "children are one level below their parent");
+    check(world.getDepth(grandChild) == 2, "moving a parent moves its subtree");
+    check(world.getComponent<Marker>(grandChild).value == 7 && world.getComponent<Transform>(grandChild).local == 3, "moved entities keep their components");
+    std::vector<ecs::Entity> children = world.getChildren(root);
+    check(children.size() == 2 && std::count(children.begin(), children.end(), child) == 1 && std::count(children.begin(), children.end(), sibling) == 1, "parents list their children");
+
+    world.setParent(child, sibling);
+    world.flush();
+    check(world.getDepth(child) == 2 && world.getDepth(grandChild) == 3, "reparenting moves the subtree deeper");
+    check(world.getChildren(root).size() == 1 && world.getChildren(sibling).size() == 1, "reparenting unlinks the old parent");
+
+    world.removeParent(child);
+    world.flush();
+    check(world.getParent(child) == ecs::nullEntity && world.getDepth(child) == 0 && world.getDepth(grandChild) == 1, "unparented entities become roots");
+    check(world.getChildren(sibling).empty(), "unparenting unlinks the old parent");
+
+    size_t visited = 0;
+    world.execute([&](const Transform &) { visited++; });
+    check(visited == 4 && world.getTotalEntityCount() == 4, "moved entities leave no rows behind");
+}
+
+// builds a forest of `rootsCount` chains of `depth` entities, each pointing to its parent's transform
+void buildForest(ecs::World &world, const int rootsCount, const int depth)
+{
+    for (int r = 0; r < rootsCount; r++)
+    {
+        ecs::Entity parent = world.addEntity(Transform{r, 0});
+        for (int d = 1; d < depth; d++)
+        {
+            const ecs::Entity child = world.addEntity(Transform{1, 0});
+            world.setParent(child, parent);
+            parent = child;
+        }
+    }
+    world.flush();
+}
+
+// every parent is visited before its children, so the world transforms accumulate down each chain in one pass
+void propagatedByDepth()
+{
+    ecs::World world;
+    buildForest(world, 300, 6);
+    world.executeByDepth([&](ecs::Entity &entity, Transform &transform) {
+        const ecs::Entity parent = world.getParent(entity);
+        transform.world = transform.local + (parent == ecs::nullEntity ? 0 : world.readComponent<Transform>(parent).world);
+    });
+
+    bool propagated = true;
+    world.execute([&](ecs::Entity &entity, const Transform &transform) {
+        const ecs::Entity parent = world.getParent(entity);
+        if (parent == ecs::nullEntity)
+            propagated &= transform.world == transform.local;
+        else
+            propagated &= transform.world == world.readComponent<Transform>(parent).world + 1;
+    });
+    check(propagated, "parents are visited before their children");
+
+    std::vector<size_t> depths;
+    world.executeByDepth([&](ecs::Entity &entity, const Transform &) { depths.push_back(world.getDepth(entity)); });
+    check(depths.size() == 1800 && std::is_sorted(depths.begin(), depths.end()), "depths are visited in order");
+}
+
+// the parallel sweeps of a depth end before the next depth's start
+void propagatedByDepthParallel()
+{
+    omp_set_num_threads(4);
+    ecs::World world;
+    buildForest(world, 5000, 5);
+    world.setParallelGrainSize(64);
+    world.executeByDepthParallel([&](ecs::Entity &entity, Transform &transform) {
+        const ecs::Entity parent = world.getParent(entity);
+        transform.world = transform.local + (parent == ecs::nullEntity ? 0 : world.readComponent<Transform>(parent).world);
+    });
+
+    bool propagated = true;
+    world.execute([&](ecs::Entity &entity, const Transform &transform) {
+        const ecs::Entity parent = world.getParent(entity);
+        if (parent != ecs::nullEntity)
+            propagated &= transform.world == world.readComponent<Transform>(parent).world + 1;
+    });
+    check(propagated, "parallel sweeps finish a depth before the next one");
+}
+} // namespace
+
+int main()
+{
+    linkedHierarchy();
+    propagatedByDepth();
+    propagatedByDepthParallel();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsHierarchyTests passed\n");
+}
@@ -0,0 +1,124 @@
+// checks of the ecs parallel executions. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <omp.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    int value;
+};
+
+struct Velocity
+{
+    int value;
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// every row of every matching archetype is visited exactly once, whatever the grain
+void visitedEveryRowOnce()
+{
+    ecs::World world;
+    constexpr int count = 20000;
+    for (int i = 0; i < count; i++)
+    {
+        if (i % 3 == 0)
+            world.addEntity(Position{i});
+        else
+            world.addEntity(Position{i}, Velocity{i});
+    }
+
+    for (const size_t grain : {size_t{1}, size_t{64}, size_t{1000}, size_t{1000000}})
+    {
+        world.setParallelGrainSize(grain);
+        std::vector<std::atomic<int>> visits(count);
+        world.executeParallel([&](const Position &position) { visits[position.value]++; });
+        bool once = true;
+        for (const auto &visit : visits)
+            once &= visit == 1;
+        check(once, "parallel executions visit every row once");
+
+        const ecs::ParallelStats stats = world.getParallelStats();
+        check(stats.tasksCount >= (count + grain - 1) / grain, "no task is larger than the grain");
+        check(stats.threadsCount >= 1 && stats.threadsCount <= stats.tasksCount, "threads are capped by the tasks");
+        check(stats.utilization >= 0 && stats.utilization <= 1.0001, "utilization is a fraction");
+    }
+}
+
+// a thread stuck on its first task has the rest of its slice taken by the others
+void stoleStuckSlice()
+{
+    // worlds size their command buffers, which cap the threads, on creation
+    omp_set_num_threads(4);
+    ecs::World world;
+    constexpr int count = 4096;
+    constexpr int grain = 16;
+    for (int i = 0; i < count; i++)
+        world.addEntity(Position{i});
+    world.setParallelGrainSize(grain);
+
+    // the first row waits until the rows of all the other tasks are done, which only happens when its slice gets
+    // stolen. gives up after a while, so a single thread still finishes
+    std::atomic<int> done = 0;
+    std::atomic<int> threadsCount = 1;
+    world.executeParallel([&](const Position &position) {
+        threadsCount = omp_get_num_threads();
+        if (position.value == 0)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            while (done != count - grain && std::chrono::steady_clock::now() - start < std::chrono::seconds(10))
+                std::this_thread::yield();
+        }
+        done++;
+    });
+
+    const ecs::ParallelStats stats = world.getParallelStats();
+    check(done == count, "stuck executions still finish");
+    if (threadsCount > 1)
+        check(stats.stealsCount > 0, "idle threads steal the remaining tasks of busy ones");
+}
+
+// structural changes recorded in parallel land in the calling threads' command buffers and all get played
+void recordedCommandsInParallel()
+{
+    omp_set_num_threads(omp_get_max_threads() * 2 + 1);
+    ecs::World world;
+    for (int i = 0; i < 50000; i++)
+        world.addEntity(Position{i});
+    world.setParallelGrainSize(128);
+    world.executeParallel([&](ecs::Entity &entity, const Position &position) { world.commands().addComponents(entity, Velocity{position.value}); });
+    world.flush();
+
+    size_t moved = 0;
+    world.execute([&](const Position &position, const Velocity &velocity) {
+        moved++;
+        check(position.value == velocity.value, "components recorded in parallel keep their values");
+    });
+    check(moved == 50000, "every thread's commands are played");
+}
+} // namespace
+
+int main()
+{
+    visitedEveryRowOnce();
+    stoleStuckSlice();
+    recordedCommandsInParallel();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsParallelTests passed\n");
+}
@@ -0,0 +1,109 @@
+// checks of the ecs prefabs. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace
+{
+struct Position
+{
+    float x, y, z;
+};
+
+// not trivially copyable, long enough to live on the heap
+struct Name
+{
+    std::string value;
+};
+
+struct Enemy
+{
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// every copy gets the prefab's components, in the archetype of the same components added one by one
+void instantiatedCopies()
+{
+    const std::string name = "a name long enough to be allocated on the heap";
+    ecs::World world;
+    const ecs::Entity existing = world.addEntity(Position{-1, 0, 0}, Name{"existing"}, Enemy{});
+    const size_t archetypesCount = world.getTotalArchetypesCount();
+    const ecs::Prefab prefab = world.createPrefab(Name{name}, Enemy{}, Position{1, 2, 3});
+    const ecs::EntityRange range = world.instantiate(prefab, 10000);
+
+    check(range.size() == 10000 && world.getTotalEntityCount() == 10001, "instantiate adds the copies right away");
+    check(world.getTotalArchetypesCount() == archetypesCount, "copies share the archetype of their components");
+    bool copied = true;
+    for (size_t i = 0; i < range.size(); i++)
+    {
+        copied &= world.isAlive(range[i]) && world.componentExists<Enemy>(range[i]);
+        const Position &position = world.getComponent<Position>(range[i]);
+        copied &= position.x == 1 && position.y == 2 && position.z == 3 && world.getComponent<Name>(range[i]).value == name;
+    }
+    check(copied, "copies hold the prefab's values");
+    check(world.getComponent<Name>(existing).value == "existing", "copies don't touch the archetype's other rows");
+
+    world.getComponent<Name>(range[0]).value = "renamed";
+    check(world.getComponent<Name>(range[1]).value == name, "non-trivial components are copied, not shared");
+    const ecs::EntityRange more = world.instantiate(prefab, 3);
+    check(world.getComponent<Name>(more[2]).value == name, "prefabs can be instantiated again");
+}
+
+// patches give each copy its own values
+void patchedCopies()
+{
+    ecs::World world;
+    const ecs::Prefab prefab = world.createPrefab(Position{0, 5, 0}, Name{"soldier"});
+    const ecs::EntityRange range = world.instantiate(prefab, 5000, [](const size_t i, Position &position, Name &name) {
+        position.x = static_cast<float>(i);
+        name.value += std::to_string(i);
+    });
+
+    bool patched = true;
+    for (size_t i = 0; i < range.size(); i++)
+    {
+        const Position &position = world.getComponent<Position>(range[i]);
+        patched &= position.x == static_cast<float>(i) && position.y == 5 && world.getComponent<Name>(range[i]).value == "soldier" + std::to_string(i);
+    }
+    check(patched, "patches are called on each copy with its index");
+
+    const ecs::EntityRange partial = world.instantiate(prefab, 10, [](const size_t i, Position &position) { position.z = static_cast<float>(i); });
+    check(world.getComponent<Position>(partial[9]).z == 9 && world.getComponent<Name>(partial[9]).value == "soldier", "patches may take some of the components");
+}
+
+// copies are ordinary entities: they migrate, get removed and recycle their handles like the others
+void modifiedCopies()
+{
+    ecs::World world;
+    const ecs::Prefab prefab = world.createPrefab(Position{1, 1, 1});
+    const ecs::EntityRange range = world.instantiate(prefab, 100);
+    world.addComponents(range[3], Name{"moved"});
+    world.removeEntity(range[4]);
+    world.flush();
+
+    check(world.getComponent<Name>(range[3]).value == "moved" && world.getComponent<Position>(range[3]).x == 1, "copies migrate with their values");
+    check(!world.isAlive(range[4]) && world.getTotalEntityCount() == 99, "copies can be removed");
+    const ecs::EntityRange reused = world.instantiate(prefab, 2);
+    check(world.isAlive(reused[0]) && world.isAlive(reused[1]) && world.getTotalEntityCount() == 101, "copies after removals are alive");
+}
+} // namespace
+
+int main()
+{
+    instantiatedCopies();
+    patchedCopies();
+    modifiedCopies();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsPrefabsTests passed\n");
+}
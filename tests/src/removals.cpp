@@ -0,0 +1,142 @@
+// checks of the ecs entity removals. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    int value;
+};
+
+// not trivially copyable, long enough to live on the heap
+struct Name
+{
+    std::string value;
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// removes the entities picked by `removed` from several chunks, and checks the survivors kept their handles and
+// components
+template <typename Func>
+void checkCompaction(const size_t count, Func &&removed, const char *description)
+{
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (size_t i = 0; i < count; i++)
+        entities.push_back(world.addEntity(Position{static_cast<int>(i)}, Name{std::string(40, 'n') + std::to_string(i)}));
+    size_t removedCount = 0;
+    for (size_t i = 0; i < count; i++)
+        if (removed(i))
+        {
+            world.removeEntity(entities[i]);
+            removedCount++;
+        }
+    check(world.stats(false).pendingRemovalsCount == removedCount, description);
+    world.flush();
+
+    const ecs::WorldStats stats = world.stats(false);
+    check(stats.pendingRemovalsCount == 0, description);
+    check(stats.entitiesCount == count - removedCount, description);
+    bool kept = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (world.isAlive(entities[i]) == removed(i))
+            kept = false;
+        else if (!removed(i))
+            kept &= world.getComponent<Position>(entities[i]).value == static_cast<int>(i) &&
+                    world.getComponent<Name>(entities[i]).value == std::string(40, 'n') + std::to_string(i);
+    }
+    check(kept, description);
+
+    size_t visited = 0;
+    world.execute([&](ecs::Entity &entity, const Position &position) {
+        visited++;
+        kept &= entity == entities[position.value];
+    });
+    check(visited == count - removedCount && kept, description);
+}
+
+// the removed rows get filled with the archetype's last rows in one pass, whatever the pattern
+void compactedRemovals()
+{
+    constexpr size_t count = 5000;
+    checkCompaction(count, [](const size_t i) { return i % 2 == 0; }, "every other row removed");
+    checkCompaction(count, [](const size_t i) { return i >= count - 700; }, "trailing rows removed");
+    checkCompaction(count, [](const size_t i) { return i < 700; }, "leading rows removed");
+    checkCompaction(count, [](const size_t i) { return i % 97 != 0; }, "most rows removed");
+    checkCompaction(count, [](const size_t) { return true; }, "all rows removed");
+}
+
+// removed entities aren't alive, but their rows stay readable until the flush, and removing them again does nothing
+void deferredRemovals()
+{
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 100; i++)
+        entities.push_back(world.addEntity(Position{i}));
+
+    for (int pass = 0; pass < 2; pass++)
+        world.execute([&](ecs::Entity &entity, const Position &position) {
+            if (position.value % 2 != 0)
+                return;
+            world.removeEntity(entity);
+            check(!world.isAlive(entity), "removed entity isn't alive");
+            check(world.getComponent<Position>(entity).value == position.value, "removed entity is readable until the flush");
+            check(world.componentExists<Position>(entity), "removed entity keeps its components until the flush");
+        });
+    check(world.stats(false).pendingRemovalsCount == 50, "removing twice marks once");
+
+    world.flush();
+    size_t visited = 0;
+    world.execute([&](const Position &position) {
+        visited++;
+        check(position.value % 2 != 0, "only kept entities are visited");
+    });
+    check(visited == 50, "removed entities are gone after the flush");
+
+    const ecs::Entity reused = world.addEntity(Position{-1});
+    check(reused.index == entities[98].index && reused.generation == 1, "removed handles are recycled with a new generation");
+    check(!world.isAlive(entities[98]), "the old handle of a recycled index is dead");
+}
+
+// removing a parent removes its descendants
+void removedDescendants()
+{
+    ecs::World world;
+    const ecs::Entity root = world.addEntity(Position{0});
+    const ecs::Entity child = world.addEntity(Position{1});
+    const ecs::Entity grandChild = world.addEntity(Position{2});
+    const ecs::Entity other = world.addEntity(Position{3});
+    world.setParent(child, root);
+    world.setParent(grandChild, child);
+    world.flush();
+
+    world.removeEntity(root);
+    world.flush();
+    check(!world.isAlive(root) && !world.isAlive(child) && !world.isAlive(grandChild), "descendants are removed along");
+    check(world.isAlive(other) && world.getTotalEntityCount() == 1, "unrelated entities are kept");
+}
+} // namespace
+
+int main()
+{
+    compactedRemovals();
+    deferredRemovals();
+    removedDescendants();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsRemovalsTests passed\n");
+}
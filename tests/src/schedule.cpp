@@ -0,0 +1,148 @@
+// checks of the ecs system schedules. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include "ecs/schedule.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <omp.h>
+#include <tuple>
+
+namespace
+{
+struct Position
+{
+    int value;
+};
+
+struct Velocity
+{
+    int value;
+};
+
+struct Health
+{
+    int value;
+};
+
+struct Player
+{
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+template <typename... Args>
+ecs::SystemAccess getAccess()
+{
+    return ecs::SystemInfo<std::tuple<Args...>>::createAccess();
+}
+
+template <typename Filter, typename... Args>
+ecs::SystemAccess getFilteredAccess()
+{
+    return ecs::SystemInfo<std::tuple<Args...>, Filter>::createAccess();
+}
+
+// writers conflict with everything touching their components, readers and tags don't conflict with each other
+void detectedConflicts()
+{
+    check(getAccess<Position &>().conflicts(getAccess<const Position &>()), "a writer conflicts with a reader");
+    check(getAccess<const Position &>().conflicts(getAccess<Position &>()), "a reader conflicts with a writer");
+    check(getAccess<Position &>().conflicts(getAccess<Position &>()), "two writers conflict");
+    check(!getAccess<const Position &>().conflicts(getAccess<const Position &>()), "readers don't conflict");
+    check(!getAccess<Position &>().conflicts(getAccess<Velocity &>()), "writers of different components don't conflict");
+    check(!getAccess<ecs::Entity &, const Position &>().conflicts(getAccess<ecs::Entity &, const Velocity &>()), "entities aren't written");
+    check(!getAccess<Player &, Position &>().conflicts(getAccess<Player &, Velocity &>()), "tags have nothing to write");
+    check(getFilteredAccess<ecs::changed<Position>, const Velocity &>().conflicts(getAccess<Position &>()), "change filters read their component");
+    check(!getFilteredAccess<ecs::without<Position>, const Velocity &>().conflicts(getAccess<Position &>()), "exclusions read nothing");
+}
+
+// conflicting systems run one after the other in registration order, on every run
+void orderedConflictingSystems()
+{
+    omp_set_num_threads(4);
+    ecs::World world;
+    for (int i = 0; i < 20000; i++)
+        world.addEntity(Position{i}, Velocity{0}, Health{0});
+
+    ecs::Schedule schedule(world);
+    schedule.add([](Position &position) { position.value *= 2; });
+    schedule.add([](const Position &position, Velocity &velocity) { velocity.value = position.value + 1; });
+    schedule.add([](const Velocity &velocity, Health &health) { health.value = velocity.value * 3; });
+    for (int run = 1; run <= 3; run++)
+    {
+        schedule.run();
+        world.flush();
+        bool ordered = true;
+        int i = 0;
+        world.execute([&](const Position &position, const Velocity &velocity, const Health &health) {
+            const int expected = i++ << run;
+            ordered &= position.value == expected && velocity.value == expected + 1 && health.value == (expected + 1) * 3;
+        });
+        check(ordered, "conflicting systems run in registration order");
+    }
+}
+
+// explicit dependencies order systems which don't conflict
+void orderedDependencies()
+{
+    omp_set_num_threads(4);
+    ecs::World world;
+    for (int i = 0; i < 20000; i++)
+        world.addEntity(Position{i}, Velocity{i});
+
+    std::atomic<int> positionsDone = 0;
+    std::atomic<bool> ranEarly = false;
+    ecs::Schedule schedule(world);
+    const size_t velocities = schedule.add([&](const Velocity &) {
+        if (positionsDone != 20000)
+            ranEarly = true;
+    });
+    const size_t positions = schedule.add([&](const Position &) { positionsDone++; });
+    schedule.addDependency(velocities, positions);
+    schedule.run();
+    world.flush();
+    check(!ranEarly, "a system runs after its dependency, even registered before it");
+    check(schedule.getSystemsCount() == 2, "every added system is counted");
+}
+
+// structural changes recorded by systems are played on the flush
+void playedSystemCommands()
+{
+    omp_set_num_threads(4);
+    ecs::World world;
+    for (int i = 0; i < 10000; i++)
+        world.addEntity(Position{i});
+
+    ecs::Schedule schedule(world);
+    schedule.add([&](ecs::Entity &entity, const Position &position) { world.commands().addComponents(entity, Velocity{position.value}); });
+    schedule.add<ecs::without<Position>>([](Health &health) { health.value++; });
+    schedule.run();
+    world.flush();
+
+    size_t moved = 0;
+    world.execute([&](const Position &position, const Velocity &velocity) {
+        moved++;
+        check(position.value == velocity.value, "components recorded by systems keep their values");
+    });
+    check(moved == 10000, "every system's commands are played");
+}
+} // namespace
+
+int main()
+{
+    detectedConflicts();
+    orderedConflictingSystems();
+    orderedDependencies();
+    playedSystemCommands();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsScheduleTests passed\n");
+}
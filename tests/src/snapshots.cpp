@@ -0,0 +1,330 @@
+// checks of the ecs world snapshots. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    float x, y, z;
+};
+
+// not trivially copyable, long enough to live on the heap
+struct Name
+{
+    std::string value;
+};
+
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// published snapshots own copies of non-trivial components, so they outlive the world's
+void publishedNonTrivialComponents()
+{
+    const std::string initial = "a name long enough to be allocated on the heap";
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 1000; i++)
+        entities.push_back(world.addEntity(Position{static_cast<float>(i), 0, 0}, Name{initial + std::to_string(i)}));
+    world.publishSnapshot();
+    const auto snapshot = world.getPublishedSnapshot();
+
+    for (const ecs::Entity entity : entities)
+        world.getComponent<Name>(entity).value = "another name long enough to be allocated on the heap";
+    for (size_t i = 0; i < entities.size(); i += 2)
+        world.removeEntity(entities[i]);
+    world.flush();
+    world.publishSnapshot();
+
+    size_t count = 0;
+    bool unchanged = true;
+    snapshot->execute([&](const Position &position, const Name &name) {
+        unchanged = unchanged && name.value == initial + std::to_string(static_cast<int>(position.x));
+        count++;
+    });
+    check(count == entities.size(), "the first snapshot keeps every entity");
+    check(unchanged, "the first snapshot keeps the names of its publish");
+
+    count = 0;
+    bool changed = true;
+    world.getPublishedSnapshot()->execute([&](const Name &name) {
+        changed = changed && name.value == "another name long enough to be allocated on the heap";
+        count++;
+    });
+    check(count == entities.size() / 2, "the second snapshot has the remaining entities");
+    check(changed, "the second snapshot has the new names");
+}
+
+std::vector<char> readFile(const std::filesystem::path &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::filesystem::path &path, const std::vector<char> &bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), bytes.size());
+}
+
+// a file whose archetype has a component this process never registered is rejected, not aborted on
+void loadedUnknownComponents()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ecsTestsUnknown.snapshot";
+    ecs::World world;
+    for (int i = 0; i < 100; i++)
+        world.addEntity(Position{static_cast<float>(i), 0, 0});
+    check(world.saveSnapshot(path), "a world of trivial components gets saved");
+
+    std::vector<char> bytes = readFile(path);
+    const size_t hash = getTypeHash_<Position>();
+    const size_t unknownHash = hash ^ 1;
+    bool replaced = false;
+    for (size_t i = 0; i + sizeof(hash) <= bytes.size() && !replaced; i++)
+        if (std::memcmp(bytes.data() + i, &hash, sizeof(hash)) == 0)
+        {
+            std::memcpy(bytes.data() + i, &unknownHash, sizeof(unknownHash));
+            replaced = true;
+        }
+    check(replaced, "the saved file has the component's hash");
+    writeFile(path, bytes);
+
+    ecs::World loaded;
+    loaded.addEntity(Position{0, 0, 0});
+    check(!loaded.loadSnapshot(path), "a snapshot of unknown components isn't loaded");
+    check(loaded.getTotalEntityCount() == 1, "a rejected snapshot leaves the world as it was");
+    std::filesystem::remove(path);
+}
+
+// entities without components and no free indices make empty sections, which load as well
+void loadedEmptySections()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ecsTestsEmpty.snapshot";
+    ecs::World world;
+    const ecs::Entity entity = world.addEntity();
+    check(world.saveSnapshot(path), "a world of an entity without components gets saved");
+
+    ecs::World loaded;
+    check(loaded.loadSnapshot(path), "a snapshot with empty sections gets loaded");
+    check(loaded.isAlive(entity) && loaded.getTotalEntityCount() == 1, "the entity without components is loaded");
+    std::filesystem::remove(path);
+}
+
+// byte offset of the entity records in a saved file, after the header and the archetype descriptors
+size_t getRecordsOffset(const std::vector<char> &bytes)
+{
+    ecs::SnapshotHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.archetypesCount; i++)
+    {
+        ecs::SnapshotArchetype descriptor;
+        std::memcpy(&descriptor, bytes.data() + offset, sizeof(descriptor));
+        offset += sizeof(descriptor) + descriptor.componentsCount * 2 * sizeof(uint64_t);
+    }
+    return offset;
+}
+
+// out of range or dangling hierarchy links and free indices are rejected before anything is adopted
+void loadedBadRecords()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ecsTestsRecords.snapshot";
+    ecs::World world;
+    const ecs::Entity parent = world.addEntity(Position{0, 0, 0});
+    const ecs::Entity child = world.addEntity(Position{1, 0, 0});
+    world.setParent(child, parent);
+    world.removeEntity(world.addEntity(Position{2, 0, 0}));
+    world.flush();
+    check(world.saveSnapshot(path), "a world with a hierarchy gets saved");
+    const std::vector<char> bytes = readFile(path);
+    const size_t recordsOffset = getRecordsOffset(bytes);
+
+    auto loads = [&](const std::vector<char> &changed) {
+        writeFile(path, changed);
+        ecs::World loaded;
+        loaded.addEntity(Position{0, 0, 0});
+        const bool result = loaded.loadSnapshot(path);
+        check(result || loaded.getTotalEntityCount() == 1, "a rejected snapshot leaves the world as it was");
+        return result;
+    };
+    check(loads(bytes), "the unchanged snapshot gets loaded");
+
+    std::vector<char> changed = bytes;
+    const uint32_t outOfRange = 1000;
+    std::memcpy(changed.data() + recordsOffset + offsetof(ecs::SnapshotRecord, parent) + child.index * sizeof(ecs::SnapshotRecord), &outOfRange, sizeof(outOfRange));
+    check(!loads(changed), "a parent out of range is rejected");
+
+    changed = bytes;
+    const uint32_t removed = 2;
+    std::memcpy(changed.data() + recordsOffset + offsetof(ecs::SnapshotRecord, firstChild) + parent.index * sizeof(ecs::SnapshotRecord), &removed, sizeof(removed));
+    check(!loads(changed), "a child that isn't alive is rejected");
+
+    changed = bytes;
+    const size_t freeIndicesOffset = recordsOffset + 3 * sizeof(ecs::SnapshotRecord);
+    std::memcpy(changed.data() + freeIndicesOffset, &outOfRange, sizeof(outOfRange));
+    check(!loads(changed), "a free index out of range is rejected");
+
+    changed = bytes;
+    std::memcpy(changed.data() + freeIndicesOffset, &parent.index, sizeof(parent.index));
+    check(!loads(changed), "a free index of a live entity is rejected");
+    std::filesystem::remove(path);
+}
+
+// byte offsets of the archetype descriptors in a saved file, after the header
+std::vector<size_t> getDescriptorOffsets(const std::vector<char> &bytes)
+{
+    ecs::SnapshotHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::vector<size_t> offsets;
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.archetypesCount; i++)
+    {
+        ecs::SnapshotArchetype descriptor;
+        std::memcpy(&descriptor, bytes.data() + offset, sizeof(descriptor));
+        offsets.push_back(offset);
+        offset += sizeof(descriptor) + descriptor.componentsCount * 2 * sizeof(uint64_t);
+    }
+    return offsets;
+}
+
+// rows and records that don't point at each other, repeated archetypes and hierarchy cycles are rejected before
+// anything is adopted
+void loadedInconsistentRows()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ecsTestsRows.snapshot";
+    ecs::World world;
+    const ecs::Entity parent = world.addEntity(Position{0, 0, 0});
+    const ecs::Entity first = world.addEntity(Position{1, 0, 0});
+    const ecs::Entity second = world.addEntity(Position{2, 0, 0});
+    const ecs::Entity root = world.addEntity(Position{3, 0, 0});
+    world.setParent(first, parent);
+    world.setParent(second, parent);
+    world.flush();
+    check(world.saveSnapshot(path), "a world with a hierarchy gets saved");
+    const std::vector<char> bytes = readFile(path);
+    const size_t recordsOffset = getRecordsOffset(bytes);
+    const std::vector<size_t> descriptorOffsets = getDescriptorOffsets(bytes);
+
+    auto getRecord = [&](const ecs::Entity entity) {
+        ecs::SnapshotRecord record;
+        std::memcpy(&record, bytes.data() + recordsOffset + entity.index * sizeof(record), sizeof(record));
+        return record;
+    };
+    auto getDescriptor = [&](const uint32_t archetype) {
+        ecs::SnapshotArchetype descriptor;
+        std::memcpy(&descriptor, bytes.data() + descriptorOffsets[archetype], sizeof(descriptor));
+        return descriptor;
+    };
+    auto withRecord = [&](const ecs::Entity entity, const size_t field, const auto value) {
+        std::vector<char> changed = bytes;
+        std::memcpy(changed.data() + recordsOffset + entity.index * sizeof(ecs::SnapshotRecord) + field, &value, sizeof(value));
+        return changed;
+    };
+    auto loads = [&](const std::vector<char> &changed) {
+        writeFile(path, changed);
+        ecs::World loaded;
+        loaded.addEntity(Position{0, 0, 0});
+        const bool result = loaded.loadSnapshot(path);
+        check(result || loaded.getTotalEntityCount() == 1, "a rejected snapshot leaves the world as it was");
+        return result;
+    };
+    check(loads(bytes), "the unchanged snapshot gets loaded");
+
+    check(!loads(withRecord(root, offsetof(ecs::SnapshotRecord, rowIndex), getRecord(parent).rowIndex)), "two records of one row are rejected");
+    check(!loads(withRecord(root, offsetof(ecs::SnapshotRecord, generation), getRecord(root).generation + 1)), "a row of another generation is rejected");
+
+    std::vector<char> changed = bytes;
+    const ecs::SnapshotRecord rootRecord = getRecord(root);
+    const ecs::SnapshotArchetype rootDescriptor = getDescriptor(rootRecord.archetype);
+    const ecs::Entity outOfRange{1000, 0};
+    std::memcpy(changed.data() + rootDescriptor.dataOffset + rootRecord.rowIndex * sizeof(ecs::Entity), &outOfRange, sizeof(outOfRange));
+    check(!loads(changed), "a row of an entity out of range is rejected");
+
+    changed = bytes;
+    const uint32_t rootDepth = rootDescriptor.depth;
+    std::memcpy(changed.data() + descriptorOffsets[getRecord(first).archetype] + offsetof(ecs::SnapshotArchetype, depth), &rootDepth, sizeof(rootDepth));
+    check(!loads(changed), "an archetype listed twice is rejected");
+
+    check(!loads(withRecord(parent, offsetof(ecs::SnapshotRecord, parent), first.index)), "a parent cycle is rejected");
+    check(!loads(withRecord(root, offsetof(ecs::SnapshotRecord, parent), parent.index)), "a child at its parent's depth is rejected");
+
+    const ecs::Entity last = getRecord(first).nextSibling == ecs::noEntityIndex ? first : second;
+    check(!loads(withRecord(last, offsetof(ecs::SnapshotRecord, nextSibling), getRecord(parent).firstChild)), "a sibling cycle is rejected");
+    std::filesystem::remove(path);
+}
+
+// the same entities saved after different removed contents give the same file, so no stale rows get written
+void savedDeterministically()
+{
+    const std::filesystem::path paths[]{std::filesystem::temp_directory_path() / "ecsTestsSaved0.snapshot", std::filesystem::temp_directory_path() / "ecsTestsSaved1.snapshot"};
+    for (int w = 0; w < 2; w++)
+    {
+        ecs::World world;
+        std::vector<ecs::Entity> entities;
+        for (int i = 0; i < 310; i++)
+            entities.push_back(world.addEntity(Position{static_cast<float>(i < 10 ? i : i * (w + 2)), 1, 2}));
+        for (int i = 309; i >= 10; i--)
+            world.removeEntity(entities[i]);
+        world.flush();
+        check(world.saveSnapshot(paths[w]), "a world with removed entities gets saved");
+    }
+    check(readFile(paths[0]) == readFile(paths[1]), "the removed rows' contents don't reach the files");
+    for (const auto &path : paths)
+        std::filesystem::remove(path);
+}
+
+// a loaded world's chunks map its file, so saving back to that path must not truncate the mapped pages
+void savedOverLoadedFile()
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "ecsTestsCheckpoint.snapshot";
+    {
+        ecs::World world;
+        for (int i = 0; i < 5000; i++)
+            world.addEntity(Position{static_cast<float>(i), 0, 0});
+        check(world.saveSnapshot(path), "a world gets saved");
+    }
+    ecs::World loaded;
+    check(loaded.loadSnapshot(path), "the saved world gets loaded");
+    loaded.execute([](Position &position) { position.y = 1; });
+    check(loaded.saveSnapshot(path), "the loaded world gets saved over its own file");
+
+    float sum = 0;
+    loaded.execute([&](const Position &position) { sum += position.y; });
+    check(sum == 5000, "the loaded world keeps its chunks after saving over its file");
+    ecs::World reloaded;
+    check(reloaded.loadSnapshot(path), "the checkpoint gets loaded");
+    sum = 0;
+    reloaded.execute([&](const Position &position) { sum += position.y; });
+    check(sum == 5000, "the checkpoint has the loaded world's changes");
+    check(!std::filesystem::exists(path.string() + ".tmp"), "the temporary file is renamed away");
+    std::filesystem::remove(path);
+}
+} // namespace
+
+int main()
+{
+    publishedNonTrivialComponents();
+    loadedUnknownComponents();
+    loadedEmptySections();
+    loadedBadRecords();
+    loadedInconsistentRows();
+    savedDeterministically();
+    savedOverLoadedFile();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsSnapshotsTests passed\n");
+}
@@ -0,0 +1,168 @@
+// checks of the ecs sparse components. prints every failed check and exits with 1 when any failed
+#include "ecs/ecs.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Position
+{
+    int value;
+};
+
+struct Velocity
+{
+    int value;
+};
+
+struct Poisoned
+{
+    int value;
+};
+
+// not trivially copyable, long enough to live on the heap
+struct Label
+{
+    std::string value;
+};
+} // namespace
+
+template <>
+inline constexpr bool ecs::isSparseComponent<Poisoned> = true;
+template <>
+inline constexpr bool ecs::isSparseComponent<Label> = true;
+
+namespace
+{
+int s_failedCount = 0;
+
+void check(const bool condition, const char *description)
+{
+    if (condition)
+        return;
+    std::fprintf(stderr, "failed: %s\n", description);
+    s_failedCount++;
+}
+
+// sparse components are set and removed right away outside executions, without moving the entity
+void toggledOutsideExecutions()
+{
+    ecs::World world;
+    const ecs::Entity entity = world.addEntity(Position{1});
+    const size_t archetypesCount = world.getTotalArchetypesCount();
+    world.addComponents(entity, Poisoned{5}, Label{std::string(40, 'l')});
+    check(world.componentExists<Poisoned>(entity) && world.getComponent<Poisoned>(entity).value == 5, "sparse components are set right away");
+    check(world.getComponent<Label>(entity).value == std::string(40, 'l'), "non-trivial sparse components are kept intact");
+    check(world.getTotalArchetypesCount() == archetypesCount, "sparse components don't move the entity");
+
+    world.addComponents(entity, Poisoned{6});
+    check(world.getComponent<Poisoned>(entity).value == 6, "adding a sparse component again replaces it");
+    world.removeComponents<Poisoned>(entity);
+    check(!world.componentExists<Poisoned>(entity) && world.componentExists<Label>(entity), "sparse components are removed right away");
+
+    world.addComponents(entity, Poisoned{7}, Velocity{0});
+    world.flush();
+    check(world.getComponent<Poisoned>(entity).value == 7, "sparse components survive table migrations");
+}
+
+// executions with sparse terms visit exactly the entities holding them, serially and in parallel
+void executedSparseTerms()
+{
+    omp_set_num_threads(4);
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 50000; i++)
+        entities.push_back(world.addEntity(Position{i}));
+    for (int i = 0; i < 50000; i += 7)
+        world.addComponents(entities[i], Poisoned{i});
+
+    size_t serialCount = 0;
+    long serialSum = 0;
+    bool matched = true;
+    world.execute([&](const Position &position, const Poisoned &poisoned) {
+        serialCount++;
+        serialSum += poisoned.value;
+        matched &= position.value == poisoned.value;
+    });
+    check(serialCount == 7143 && matched, "serial executions visit the sparse set's entities");
+
+    world.setParallelGrainSize(64);
+    std::atomic<size_t> parallelCount = 0;
+    std::atomic<long> parallelSum = 0;
+    std::atomic<bool> parallelMatched = true;
+    world.executeParallel([&](const Position &position, Poisoned &poisoned) {
+        parallelCount++;
+        parallelSum += poisoned.value;
+        if (position.value != poisoned.value)
+            parallelMatched = false;
+    });
+    check(parallelCount == serialCount && parallelSum == serialSum && parallelMatched, "parallel executions visit the same entities");
+
+    size_t excluded = 0;
+    world.execute<ecs::without<Poisoned>>([&](const Position &position) {
+        excluded++;
+        matched &= position.value % 7 != 0;
+    });
+    check(excluded == 50000 - 7143 && matched, "sparse exclusions skip the entities holding them");
+}
+
+// toggles inside executions wait for the flush, so the visited set doesn't change under the execution
+void toggledDuringExecutions()
+{
+    ecs::World world;
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 10000; i++)
+        entities.push_back(world.addEntity(Position{i}));
+    for (int i = 0; i < 10000; i += 2)
+        world.addComponents(entities[i], Poisoned{i});
+
+    size_t visited = 0;
+    world.execute([&](ecs::Entity &entity, const Position &position, const Poisoned &poisoned) {
+        visited++;
+        check(position.value == poisoned.value, "values stay in place during executions");
+        world.removeComponents<Poisoned>(entity);
+        world.addComponents(entities[position.value + 1], Poisoned{position.value + 1});
+    });
+    check(visited == 5000, "toggles don't change the visited entities");
+    check(world.componentExists<Poisoned>(entities[0]) && !world.componentExists<Poisoned>(entities[1]), "toggles wait for the flush");
+
+    world.flush();
+    size_t moved = 0;
+    bool odd = true;
+    world.execute([&](const Position &position, const Poisoned &poisoned) {
+        moved++;
+        odd &= position.value % 2 == 1 && position.value == poisoned.value;
+    });
+    check(moved == 5000 && odd, "toggles are played on the flush");
+}
+
+// removed entities lose their sparse components, so recycled indices start without them
+void removedWithEntities()
+{
+    ecs::World world;
+    const ecs::Entity entity = world.addEntity(Position{1}, Label{std::string(40, 'r')});
+    world.removeEntity(entity);
+    world.flush();
+    const ecs::Entity reused = world.addEntity(Position{2});
+    check(reused.index == entity.index, "the removed index is recycled");
+    check(!world.componentExists<Label>(reused), "recycled indices have no sparse components");
+    size_t visited = 0;
+    world.execute([&](const Label &) { visited++; });
+    check(visited == 0, "removed entities leave their sparse sets");
+}
+} // namespace
+
+int main()
+{
+    toggledOutsideExecutions();
+    executedSparseTerms();
+    toggledDuringExecutions();
+    removedWithEntities();
+    if (s_failedCount > 0)
+        return 1;
+    std::printf("ecsSparseTests passed\n");
+}